@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+// Helpers for packed BCD values: tens in the high nibble and ones in the low nibble
+// Time values are kept in this form so digits can be sent to the display without division
+
+/**
+ * Add one to a packed BCD value, carrying from the ones into the tens
+ */
+inline static uint8_t bcd_increment(uint8_t value)
+{
+    ++value;
+
+    // Skip the six unused codes between x9 and (x+1)0
+    if ((value & 0x0F) == 0x0A) {
+        value += 6;
+    }
+
+    return value;
+}
+
+/**
+ * Convert a packed BCD value to binary
+ */
+inline static uint8_t bcd_to_bin(uint8_t value)
+{
+    const uint8_t tens = value >> 4;
+
+    // tens * 10 without a multiply
+    return (value & 0x0F) + (tens << 3) + (tens << 1);
+}
+
+/**
+ * Subtract one from a packed BCD value, borrowing from the tens
+ */
+inline static uint8_t bcd_decrement(uint8_t value)
+{
+    // Skip the six unused codes between (x+1)0 and x9
+    if ((value & 0x0F) == 0) {
+        value -= 6;
+    }
+
+    return value - 1;
+}
+
+/**
+ * Convert a binary value less than 100 to packed BCD
+ */
+inline static uint8_t bin_to_bcd(uint8_t value)
+{
+    uint8_t tens = 0;
+
+    while (value >= 10) {
+        value -= 10;
+        ++tens;
+    }
+
+    return (tens << 4) | value;
+}
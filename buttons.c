@@ -0,0 +1,43 @@
+#include "buttons.h"
+
+ButtonEvent button_update(Button* button, bool down)
+{
+    // Integrate the raw input so noise and bounce have to persist to change the state
+    if (down) {
+        if (button->integrator != kButtonDebounceTicks) {
+            ++button->integrator;
+        }
+    } else if (button->integrator != 0) {
+        --button->integrator;
+    }
+
+    if (!button->pressed) {
+        if (button->integrator == kButtonDebounceTicks) {
+            button->pressed = true;
+            button->heldTicks = 0;
+        }
+
+        return kButton_None;
+    }
+
+    if (button->integrator == 0) {
+        button->pressed = false;
+
+        // Long presses have already been reported while held
+        return (button->heldTicks < kButtonLongTicks) ? kButton_Short : kButton_None;
+    }
+
+    ++button->heldTicks;
+
+    if (button->heldTicks == kButtonLongTicks) {
+        return kButton_Long;
+    }
+
+    if (button->heldTicks == kButtonLongTicks + kButtonRepeatTicks) {
+        // Stay within range of the counter by winding back to the last event
+        button->heldTicks = kButtonLongTicks;
+        return kButton_Repeat;
+    }
+
+    return kButton_None;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Ticks the raw input must agree for a press or release to be accepted
+#define kButtonDebounceTicks 4
+
+// Ticks a button must be held for a long press, and between repeats after that
+#define kButtonLongTicks 80
+#define kButtonRepeatTicks 15
+
+typedef enum ButtonEvent {
+    kButton_None = 0,
+
+    // Released before the long press time
+    kButton_Short,
+
+    // Held for the long press time
+    kButton_Long,
+
+    // Still held after a long press (sent every kButtonRepeatTicks)
+    kButton_Repeat,
+} ButtonEvent;
+
+/**
+ * Debounce and timing state for one button
+ */
+typedef struct Button {
+    // Counts up while the input reads pressed and down while released
+    uint8_t integrator;
+
+    // Ticks since the debounced press started
+    uint8_t heldTicks;
+
+    bool pressed;
+} Button;
+
+/**
+ * Feed a raw sample to a button (called once per timebase tick)
+ *
+ * Returns an event if this sample completes one.
+ */
+ButtonEvent button_update(Button* button, bool down);
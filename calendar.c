@@ -0,0 +1,196 @@
+#include "calendar.h"
+
+#include "bcd.h"
+
+// Days in each month of a non-leap year as packed BCD
+static const uint8_t kDaysInMonth[12] = {
+    0x31, 0x28, 0x31, 0x30, 0x31, 0x30, 0x31, 0x31, 0x30, 0x31, 0x30, 0x31,
+};
+
+bool calendar_is_leap_year(uint8_t year)
+{
+    // Every fourth year is a leap year between 1901 and 2099
+    return (bcd_to_bin(year) & 0x03) == 0;
+}
+
+uint8_t calendar_days_in_month(const DateTime* now)
+{
+    const uint8_t month = bcd_to_bin(now->month);
+
+    if (month == 2 && calendar_is_leap_year(now->year)) {
+        return 0x29;
+    }
+
+    return kDaysInMonth[month - 1];
+}
+
+uint16_t calendar_day_of_year(const DateTime* now)
+{
+    const uint8_t month = bcd_to_bin(now->month);
+    uint16_t days = bcd_to_bin(now->day);
+
+    for (uint8_t i = 0; i < month - 1; ++i) {
+        days += bcd_to_bin(kDaysInMonth[i]);
+    }
+
+    if (month > 2 && calendar_is_leap_year(now->year)) {
+        ++days;
+    }
+
+    return days;
+}
+
+void calendar_increment_second(DateTime* now)
+{
+    // Fields are packed BCD, so roll over at 0x60 rather than 60
+    // A leap second (0x60) also rolls over to the next minute
+    now->second = bcd_increment(now->second);
+    if (now->second < 0x60) {
+        return;
+    }
+
+    now->second = 0;
+    now->minute = bcd_increment(now->minute);
+    if (now->minute != 0x60) {
+        return;
+    }
+
+    now->minute = 0;
+    now->hour = bcd_increment(now->hour);
+    if (now->hour != 0x24) {
+        return;
+    }
+
+    now->hour = 0;
+    calendar_increment_day(now);
+}
+
+void calendar_increment_day(DateTime* now)
+{
+    ++now->weekday;
+    if (now->weekday == 7) {
+        now->weekday = 0;
+    }
+
+    if (now->day != calendar_days_in_month(now)) {
+        now->day = bcd_increment(now->day);
+        return;
+    }
+
+    now->day = 0x01;
+
+    if (now->month != 0x12) {
+        now->month = bcd_increment(now->month);
+        return;
+    }
+
+    now->month = 0x01;
+    now->year = (now->year == 0x99) ? 0x00 : bcd_increment(now->year);
+}
+
+void calendar_decrement_day(DateTime* now)
+{
+    now->weekday = (now->weekday == 0) ? 6 : now->weekday - 1;
+
+    if (now->day != 0x01) {
+        now->day = bcd_decrement(now->day);
+        return;
+    }
+
+    if (now->month != 0x01) {
+        now->month = bcd_decrement(now->month);
+    } else {
+        now->month = 0x12;
+        now->year = (now->year == 0x00) ? 0x99 : bcd_decrement(now->year);
+    }
+
+    now->day = calendar_days_in_month(now);
+}
+
+void calendar_add_minutes(DateTime* now, int16_t minutes)
+{
+    minutes += (bcd_to_bin(now->hour) * 60) + bcd_to_bin(now->minute);
+
+    while (minutes < 0) {
+        minutes += 24 * 60;
+        calendar_decrement_day(now);
+    }
+
+    while (minutes >= 24 * 60) {
+        minutes -= 24 * 60;
+        calendar_increment_day(now);
+    }
+
+    now->hour = bin_to_bcd(minutes / 60);
+    now->minute = bin_to_bcd(minutes % 60);
+}
+
+// Return from calendar_compare if a field differs between the two dates
+#define CALENDAR_COMPARE_FIELD(field) \
+    if (a->field != b->field) { return (a->field < b->field) ? -1 : 1; }
+
+int8_t calendar_compare(const DateTime* a, const DateTime* b)
+{
+    // Packed BCD sorts the same as binary, so fields can be compared directly
+    CALENDAR_COMPARE_FIELD(year);
+    CALENDAR_COMPARE_FIELD(month);
+    CALENDAR_COMPARE_FIELD(day);
+    CALENDAR_COMPARE_FIELD(hour);
+    CALENDAR_COMPARE_FIELD(minute);
+    CALENDAR_COMPARE_FIELD(second);
+
+    return 0;
+}
+
+void calendar_set_days(DateTime* now, uint16_t days)
+{
+    // 1st January 2000 was a Saturday
+    now->weekday = (days + 6) % 7;
+
+    // Whole years, with 2000 being a leap year
+    uint8_t year = 0;
+
+    for (;;) {
+        const uint16_t yearLength = (year & 0x03) == 0 ? 366 : 365;
+
+        if (days < yearLength) {
+            break;
+        }
+
+        days -= yearLength;
+        ++year;
+    }
+
+    now->year = bin_to_bcd(year);
+    now->month = 0x01;
+    now->day = 0x01;
+
+    // Whole months
+    for (;;) {
+        const uint8_t monthLength = bcd_to_bin(calendar_days_in_month(now));
+
+        if (days < monthLength) {
+            break;
+        }
+
+        days -= monthLength;
+        now->month = bcd_increment(now->month);
+    }
+
+    now->day = bin_to_bcd(days + 1);
+}
+
+uint8_t calendar_weekday(const DateTime* now)
+{
+    // Sakamoto's method, with January and February counted as the end of the previous year
+    static const uint8_t monthOffset[12] = {0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4};
+
+    const uint8_t month = bcd_to_bin(now->month);
+    uint16_t year = 2000 + bcd_to_bin(now->year);
+
+    if (month < 3) {
+        --year;
+    }
+
+    return (year + (year / 4) - (year / 100) + (year / 400) + monthOffset[month - 1] + bcd_to_bin(now->day)) % 7;
+}
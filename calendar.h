@@ -0,0 +1,64 @@
+#pragma once
+
+#include "nmea.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Advance the time by one second, rolling over the date as needed
+ * This moves from a leap second (hh:mm:60) to the next minute too.
+ */
+void calendar_increment_second(DateTime* now);
+
+/**
+ * Move the date forward one day, rolling over the month and year as needed
+ */
+void calendar_increment_day(DateTime* now);
+
+/**
+ * Move the date back one day, rolling back the month and year as needed
+ */
+void calendar_decrement_day(DateTime* now);
+
+/**
+ * Move the time forward or back by a number of minutes, adjusting the date if midnight is crossed
+ * This is intended for occasional use (eg. applying a timezone), not every second.
+ */
+void calendar_add_minutes(DateTime* now, int16_t minutes);
+
+/**
+ * Compare two date/times, ignoring the weekday
+ * Returns a negative value if a is before b, zero if they're equal, or positive if a is after b.
+ */
+int8_t calendar_compare(const DateTime* a, const DateTime* b);
+
+/**
+ * Return true if the (two digit, BCD) year is a leap year
+ * This is only correct for 2000 to 2099.
+ */
+bool calendar_is_leap_year(uint8_t year);
+
+/**
+ * Return the number of days in the month of the passed date as packed BCD
+ */
+uint8_t calendar_days_in_month(const DateTime* now);
+
+/**
+ * Return the day of the year, counting January 1st as day 1
+ */
+uint16_t calendar_day_of_year(const DateTime* now);
+
+/**
+ * Set the date from a count of days since 1st January 2000, including the weekday
+ * Only the date fields are changed. This is only correct up to the end of 2099.
+ */
+void calendar_set_days(DateTime* now, uint16_t days);
+
+/**
+ * Calculate the day of the week from scratch (0 = Sunday)
+ *
+ * This is relatively expensive, so it's only needed when the date is set from outside. The
+ * increment and decrement functions keep the weekday field up to date themselves.
+ */
+uint8_t calendar_weekday(const DateTime* now);
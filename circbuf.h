@@ -1,7 +1,12 @@
 #pragma once
 
+// Capacity of the buffer, which must be a power of two so indices can wrap with a mask
+// This holds a little over one maximum length NMEA sentence, so a whole line can be collected
+// before the reader is woken.
+#define kCircBufSize 128
+
 typedef struct CircBuf {
-    uint8_t data[64];
+    uint8_t data[kCircBufSize];
     uint8_t writeIndex;
     uint8_t readIndex;
 } CircBuf;
@@ -11,14 +16,49 @@ inline static bool circbuf_is_empty(CircBuf* buf)
     return buf->writeIndex == buf->readIndex;
 }
 
-inline static void circbuf_append(CircBuf* buf, uint8_t byte)
+/**
+ * Return the number of bytes waiting to be read
+ */
+inline static uint8_t circbuf_count(CircBuf* buf)
+{
+    return (buf->writeIndex - buf->readIndex) & (kCircBufSize - 1);
+}
+
+/**
+ * Return the number of bytes that can be read in place from circbuf_peek() without wrapping
+ */
+inline static uint8_t circbuf_contiguous(CircBuf* buf)
 {
-    uint8_t nextWriteIndex = buf->writeIndex + 1;
+    // Read the write index once as it can be moved by an interrupt
+    const uint8_t writeIndex = buf->writeIndex;
 
-    if (nextWriteIndex >= sizeof(buf->data)) {
-        nextWriteIndex = 0;
+    if (writeIndex >= buf->readIndex) {
+        return writeIndex - buf->readIndex;
     }
 
+    return kCircBufSize - buf->readIndex;
+}
+
+/**
+ * Return a pointer to the next unread byte
+ */
+inline static const uint8_t* circbuf_peek(CircBuf* buf)
+{
+    return &buf->data[buf->readIndex];
+}
+
+/**
+ * Mark bytes read in place as consumed (count must not exceed circbuf_contiguous())
+ */
+inline static void circbuf_commit(CircBuf* buf, uint8_t count)
+{
+    buf->readIndex = (buf->readIndex + count) & (kCircBufSize - 1);
+}
+
+inline static void circbuf_append(CircBuf* buf, uint8_t byte)
+{
+    const uint8_t nextWriteIndex = (buf->writeIndex + 1) & (kCircBufSize - 1);
+
     // Append the received byte if the buffer has room
     if (nextWriteIndex != buf->readIndex) {
         buf->data[buf->writeIndex] = byte;
@@ -30,12 +70,7 @@ inline static uint8_t circbuf_pop(CircBuf* buf)
 {
     const uint8_t value = buf->data[buf->readIndex];
 
-    uint8_t nextReadIndex = buf->readIndex + 1;
-    if (nextReadIndex >= sizeof(buf->data)) {
-        nextReadIndex = 0;
-    }
-
-    buf->readIndex = nextReadIndex;
+    buf->readIndex = (buf->readIndex + 1) & (kCircBufSize - 1);
 
     return value;
-}
\ No newline at end of file
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+// Build-time options
+// Each of these can be overridden by adding it to CPPDEFINES in the SConscript
+
+/**
+ * Timestamp the GPS time pulse with TIM2 input capture channel 1 (pin D4) instead of taking
+ * it as an external interrupt on port B. Rev 1.0 boards need the timepulse line jumpered from
+ * B4 to D4 to use this.
+ */
+#ifndef CONFIG_PPS_CAPTURE
+#define CONFIG_PPS_CAPTURE 0
+#endif
+
+/**
+ * Offer an automatic timezone, looked up from the GPS position in the table generated by
+ * scripts/tz_index.py (tzindex_data.h). This is selected after UTC+14:00 with the timezone button.
+ */
+#ifndef CONFIG_AUTO_TIMEZONE
+#define CONFIG_AUTO_TIMEZONE 0
+#endif
+
+/**
+ * Set display brightness from the time of sunrise and sunset at the GPS position, rather than
+ * following the light sensor. The light sensor is then only sampled once a second, and can only
+ * dim the display below the schedule (eg. in a dark room during the day).
+ */
+#ifndef CONFIG_SOLAR_BRIGHTNESS
+#define CONFIG_SOLAR_BRIGHTNESS 0
+#endif
+
+/**
+ * Sample the light sensor (LDR on pin D3). Disabling this with CONFIG_SOLAR_BRIGHTNESS leaves
+ * the ADC and TIM1 switched off entirely.
+ */
+#ifndef CONFIG_LIGHT_SENSOR
+#define CONFIG_LIGHT_SENSOR 1
+#endif
+
+/**
+ * Read the number of satellites in view and the best signal strength from GSV sentences, and
+ * show them while waiting for a fix. Without this, GSV sentences are turned off at the receiver.
+ */
+#ifndef CONFIG_GSV_STATUS
+#define CONFIG_GSV_STATUS 1
+#endif
+
+/**
+ * Configure a MediaTek (MT33xx) receiver with PMTK commands instead of a u-blox receiver with UBX
+ * messages. MediaTek receivers only send NMEA, so the options below that use UBX are turned off.
+ */
+#ifndef CONFIG_GPS_MTK
+#define CONFIG_GPS_MTK 0
+#endif
+
+/**
+ * Configure the receiver with a single CFG-VALSET transaction instead of the legacy CFG-TP5,
+ * CFG-NAV5 and CFG-MSG messages. This needs a u-blox 9 or later receiver (eg. MAX-M10S).
+ */
+#ifndef CONFIG_UBX_VALSET
+#define CONFIG_UBX_VALSET 0
+#endif
+
+/**
+ * Take the time of each pulse from the receiver's UBX TIM-TP message, which gives the exact UTC
+ * time the next pulse marks, instead of inferring it from the last NMEA time. NMEA times are
+ * still used if TIM-TP stops arriving.
+ */
+#ifndef CONFIG_UBX_TIMEPULSE
+#define CONFIG_UBX_TIMEPULSE (!CONFIG_GPS_MTK)
+#endif
+
+/**
+ * Follow leap second announcements from the receiver's UBX NAV-TIMELS message, so an inserted
+ * second is shown as 23:59:60 UTC. This needs a receiver with protocol version 16 or later
+ * (eg. u-blox 8): older receivers reject the message and the time is corrected by the next fix.
+ */
+#ifndef CONFIG_LEAP_SECONDS
+#define CONFIG_LEAP_SECONDS (!CONFIG_GPS_MTK)
+#endif
+
+/**
+ * Put the receiver into backup through its EXTINT pin (B5) once the time is locked, waking it
+ * every few minutes to check the time. In between, seconds are counted from the time pulse
+ * period measured while it was running. This needs the receiver's EXTINT0 pin wired to B5.
+ */
+#ifndef CONFIG_GPS_POWER_SAVE
+#define CONFIG_GPS_POWER_SAVE 0
+#endif
+
+// UBX frames are read from any u-blox receiver, as configuration waits on their acknowledgements
+#define CONFIG_UBX_INPUT (!CONFIG_GPS_MTK)
+
+#if CONFIG_GPS_MTK && (CONFIG_UBX_TIMEPULSE || CONFIG_LEAP_SECONDS || CONFIG_GPS_POWER_SAVE)
+#error UBX messages and power save need a u-blox receiver (CONFIG_GPS_MTK 0)
+#endif
+
+// Position is only parsed from the GPS when a feature needs it
+#define CONFIG_GPS_POSITION (CONFIG_AUTO_TIMEZONE || CONFIG_SOLAR_BRIGHTNESS)
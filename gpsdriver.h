@@ -0,0 +1,61 @@
+#pragma once
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * NMEA sentences the receiver can be asked to send
+ *
+ * Values match the u-blox NMEA message IDs. Backends map these to their own numbering.
+ */
+typedef enum GpsMessage {
+    kGpsMessage_GGA = 0, // Global positioning system fix data
+    kGpsMessage_GLL,     // Latitude and longitude, with time of position fix and status
+    kGpsMessage_GSA,     // GNSS DOP and Active Satellites
+    kGpsMessage_GSV,     // GNSS Satellites in View
+    kGpsMessage_RMC,     // Recommended Minimum data
+    kGpsMessage_VTG,     // Course over ground and Ground speed
+    kGpsMessage_GRS,     // GNSS Range Residuals
+    kGpsMessage_GST,     // GNSS Pseudo Range Error Statistics
+    kGpsMessage_ZDA,     // Time and Date
+
+    kNumGpsMessages
+} GpsMessage;
+
+// Receiver configuration is implemented once per protocol, selected with CONFIG_GPS_MTK:
+// UBX for u-blox receivers in ubxgps.c, and PMTK for MediaTek receivers in mtkgps.c.
+
+/**
+ * Configure the time pulse and navigation settings, and turn off output the clock doesn't read
+ *
+ * NMEA sentences are set to the given rates, as for gps_driver_set_message_rates(). This
+ * returns once the first message is queued: the u-blox backend sends each of the rest once the
+ * receiver acknowledges the last (see ubx_handle_ack()).
+ */
+void gps_driver_init(const uint8_t* rates);
+
+/**
+ * Set how often each NMEA sentence is sent in fixes per sentence, where 0 turns it off
+ *
+ * Rates are indexed by GpsMessage. Backends that can set sentences individually only send the
+ * ones that changed since the last call. If configuration is still in progress, the new rates
+ * are picked up when it gets to them.
+ */
+void gps_driver_set_message_rates(const uint8_t* rates);
+
+/**
+ * Queue bytes to send to the receiver
+ *
+ * This returns as soon as the bytes are queued: it only waits if the transmit buffer fills up.
+ * Bytes are sent from the UART transmit interrupt. The buffer holds kCircBufSize - 1 bytes, so
+ * anything longer (eg. the CFG-VALSET sent by gps_driver_init()) waits for the start of it to be
+ * sent: around 80ms at 9600 baud for the largest.
+ */
+extern void uart_send(const uint8_t* bytes, uint16_t length);
+
+/**
+ * Return true once everything queued by uart_send() has finished sending
+ */
+extern bool uart_send_complete(void);
@@ -0,0 +1,92 @@
+#include "leap.h"
+
+#include "bcd.h"
+#include "calendar.h"
+
+// Date of the day ending with a leap second, only valid when _leapChange is non-zero
+static DateTime _leapDay;
+
+// +1 for an inserted leap second, -1 for a removed one, or 0 when none is scheduled
+static int8_t _leapChange = 0;
+
+#define kSecondsPerDay 86400L
+
+void leap_schedule(const DateTime* utc, int32_t secondsToEvent, int8_t change)
+{
+    // Leap seconds only happen at the end of a UTC day, so look half a day before the event to
+    // find that day. This avoids any doubt about whether the countdown is to the start or end of
+    // the leap second itself.
+    const int32_t secondOfDay = (bcd_to_bin(utc->hour) * 3600L) + (bcd_to_bin(utc->minute) * 60) + bcd_to_bin(utc->second);
+    const int32_t untilLeapDay = secondOfDay + secondsToEvent - (kSecondsPerDay / 2);
+
+    if (change == 0 || untilLeapDay < 0) {
+        _leapChange = 0;
+        return;
+    }
+
+    _leapDay = *utc;
+
+    for (uint16_t days = untilLeapDay / kSecondsPerDay; days != 0; --days) {
+        calendar_increment_day(&_leapDay);
+    }
+
+    _leapChange = change;
+}
+
+/**
+ * Return the change a scheduled leap second makes after a UTC second, or 0 if there's none
+ *
+ * The schedule is kept after the leap second has passed, so times worked out from sentences that
+ * straddle it still follow it. It stops matching once the day is over.
+ */
+static int8_t leap_change_after(const DateTime* utc)
+{
+    // Only the last two seconds of a UTC day need a closer look
+    if (_leapChange != 0 && utc->second >= 0x58 && utc->minute == 0x59 && utc->hour == 0x23 &&
+        utc->day == _leapDay.day && utc->month == _leapDay.month && utc->year == _leapDay.year) {
+
+        // Inserted after 23:59:59, or 23:59:59 removed
+        if ((_leapChange > 0 && utc->second == 0x59) || (_leapChange < 0 && utc->second == 0x58)) {
+            return _leapChange;
+        }
+    }
+
+    return 0;
+}
+
+void leap_next_second(DateTime* utc)
+{
+    const int8_t change = leap_change_after(utc);
+
+    if (change > 0) {
+        utc->second = 0x60;
+        return;
+    }
+
+    if (change < 0) {
+        calendar_increment_second(utc);
+    }
+
+    calendar_increment_second(utc);
+}
+
+void leap_increment_second(DateTime* utc, DateTime* local)
+{
+    const int8_t change = leap_change_after(utc);
+
+    if (change > 0) {
+        // The local time is a whole number of minutes from UTC, so it gets a :60 too
+        utc->second = 0x60;
+        local->second = 0x60;
+        return;
+    }
+
+    if (change < 0) {
+        // Skip straight past 23:59:59
+        calendar_increment_second(utc);
+        calendar_increment_second(local);
+    }
+
+    calendar_increment_second(utc);
+    calendar_increment_second(local);
+}
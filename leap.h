@@ -0,0 +1,30 @@
+#pragma once
+
+#include "nmea.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Schedule a leap second announced by the receiver
+ *
+ * utc is the current time, secondsToEvent is the receiver's countdown to the leap second and
+ * change is +1 for an inserted second or -1 for a removed one. A change of zero, or an event
+ * that has already passed, cancels any scheduled leap second.
+ */
+void leap_schedule(const DateTime* utc, int32_t secondsToEvent, int8_t change);
+
+/**
+ * Advance a UTC time by one second, following a scheduled leap second as for leap_increment_second()
+ *
+ * This is for working out the time of a coming pulse, and leaves the schedule as it is.
+ */
+void leap_next_second(DateTime* utc);
+
+/**
+ * Advance a UTC time and its local equivalent by one second
+ *
+ * On the night of a scheduled leap second this goes from 23:59:59 to 23:59:60 (UTC), or skips
+ * 23:59:59 for a removed second. Other seconds cost one comparison over calendar_increment_second.
+ */
+void leap_increment_second(DateTime* utc, DateTime* local);
@@ -1,9 +1,23 @@
 #include "stm8s.h"
+#include "stm8s_itc.h"
 #include "stm8s_uart1.h"
 
+#include "bcd.h"
+#include "buttons.h"
+#include "calendar.h"
 #include "circbuf.h"
+#include "config.h"
 #include "delay.h"
+#include "gpsdriver.h"
 #include "nmea.h"
+#include "leap.h"
+#include "pps.h"
+#include "scheduler.h"
+#include "settings.h"
+#include "solar.h"
+#include "timebase.h"
+#include "timezone.h"
+#include "tzindex.h"
 #include "ubxgps.h"
 
 #include <stdbool.h>
@@ -23,6 +37,10 @@
 #define GPS_PIN_TIMEPULSE (1<<4)
 #define GPS_PIN_EXTINT (1<<5)
 
+// Alternate timepulse input when using TIM2 input capture (CONFIG_PPS_CAPTURE)
+#define PPS_CAPTURE_PORT GPIOD
+#define PPS_CAPTURE_PIN (1<<4)
+
 #define BUTTON_PORT GPIOA
 #define BUTTON_PIN_TIMEZONE (1<<2)
 #define BUTTON_PIN_DST (1<<3)
@@ -36,201 +54,111 @@
 
 #define kNumDigits 6
 #define kNumSegments 8
+
+// Frame being drawn by the main loop
 static uint8_t _segmentWiseData[kNumSegments];
 
-static int8_t _timezoneOffset = 13;
-static volatile DateTime _gpsTime = {0, 0, 0, 0, 0, 0};
-static volatile bool _gpsPreparingNextTime = false;
+// Last complete frame, which is what max7219_write_digits() sends
+// Frames are only swapped in whole by max7219_publish_digits(), so a time pulse arriving part way
+// through drawing latches the previous frame rather than a mix of the two.
+static uint8_t _segmentWiseFrame[kNumSegments];
 
-char uart_read_byte(void);
+// Timezone used until one is saved from the buttons: UTC+12:00 with New Zealand daylight saving
+#define kDefaultTimezone 34
+#define kDefaultDstMode kDstMode_Rule
 
-static inline void uart_send_blocking(uint8_t byte)
-{
-    // Wait for the last transmission to complete
-    while ( (UART1->SR & UART1_SR_TC) == 0 );
+// UTC time to be shown at the next time pulse
+static DateTime _gpsTime = {0, 0, 0, 0x01, 0x01, 0, 0};
 
-    // Put the byte in the TX buffer
-    UART1->DR = byte;
-}
+// Local equivalent of _gpsTime
+// This is advanced alongside _gpsTime so the offset doesn't need applying every second
+static DateTime _localTime;
 
-static void uart_send_stream_blocking(uint8_t* bytes, uint8_t length)
-{
-    while (length > 0) {
-        uart_send_blocking(*bytes);
+// Set by the time pulse interrupt to have the display task advance to the next second
+static volatile bool _ppsTicked = false;
 
-        --length;
-        ++bytes;
-    }
-}
+// Set by the parse task when any complete sentence arrives from the GPS
+static bool _gpsSentenceSeen = false;
 
-/**
- * Add a value to a checksum (8-Bit Fletcher Algorithm)
- * The initial checksum value must be {0,0}
- */
-static inline void ubx_update_checksum(uint8_t* checksum, uint8_t value)
-{
-	checksum[0] += value;
-	checksum[1] += checksum[0];
-}
+// True when _gpsTime holds a time read from the GPS
+static bool _gpsTimeValid = false;
 
-static void ubx_update_checksum_multi(uint8_t* checksum, uint8_t* data, uint16_t length)
-{
-	for (uint16_t i = 0; i < length; ++i) {
-		ubx_update_checksum(checksum, data[i]);
-	}
-}
+// Baud rates the GPS is probed at, in the order they're tried after the last one used
+// The first is the default for u-blox receivers. Saved settings store an index into this.
+static const uint32_t kGpsBaudRates[] = {9600, 38400, 115200, 4800, 19200, 57600};
 
-enum UbxResponse {
-    kUbxNack = 0, // Matches the NACK message ID
-    kUbxAck = 1,  // Matches the ACK message ID
-    kUbxResponseTimeout = 0x55,
-    kUbxBadResponse = 0xBD
-};
-
-static enum UbxResponse ubx_send(uint8_t msgClass, uint8_t msgId, uint8_t* data, uint16_t length)
-{
-    // Send packet to receiver
-    {
-    	uint8_t header[6] = {
-    		0xB5, 0x62, // Every message starts with these sync characters
-    		msgClass,
-    		msgId,
-    		(uint8_t) (length & 0xFF), // Payload length as little-endian (LSB first)
-    		(uint8_t) (length >> 8),
-    	};
+// Index of the baud rate UART1 is currently running at
+static uint8_t _gpsBaudIndex = 0;
 
-    	uint8_t checksum[2] = {0, 0};
+// Set once a sentence or UBX frame with a valid checksum has been received at _gpsBaudIndex
+static bool _gpsBaudFound = false;
 
-    	// Checksum includes the payload and the header minus its two fixed bytes
-    	ubx_update_checksum_multi(checksum, (uint8_t*)(&header) + 2, sizeof(header) - 2);
-    	ubx_update_checksum_multi(checksum, data, length);
-
-    	// Send the message over serial
-    	uart_send_stream_blocking(header, sizeof(header));
-    	uart_send_stream_blocking(data, length);
-    	uart_send_stream_blocking(checksum, sizeof(checksum));
-    }
-
-    // Look for receiver response
-    // TODO: make this a more generic UBX packet reading routine that verifies checksum
-    // TODO: handle response timeout. Currently this blocks forever if the GPS doesn't respond
-    {
-        const uint8_t response_header[] = {0xB5, 0x62, 0x05};
+// Time to receive one byte (start bit, 8 data bits and stop bit) in microseconds
+static uint16_t _uartByteTimeUs = 1042;
 
-        uint8_t searchIndex = 0;
-        enum UbxResponse response = kUbxBadResponse;
+#if CONFIG_LIGHT_SENSOR
+// Latest unfiltered reading from the LDR, written by the ADC interrupt
+static volatile uint16_t _ldrReading = 0;
+#endif
 
-        // Wait for the ACK/NACK response header
-        while (searchIndex < sizeof(response_header)) {
-            const char byte = uart_read_byte();
+// NMEA sentence the time is read from
+// The time is read from the shortest sentence that has everything needed: ZDA is around half
+// the length of RMC, but only RMC carries a position as well as the date.
+#if CONFIG_GPS_POSITION
+#define kGpsTimeMessage kGpsMessage_RMC
+#else
+#define kGpsTimeMessage kGpsMessage_ZDA
+#endif
 
-            if (byte == response_header[searchIndex]) {
-                ++searchIndex;
-            }
-        }
-
-        // Read message ID as response
-        response = uart_read_byte();
-
-        // Discard packet length as we're not using it here
-        uart_read_byte();
-        uart_read_byte();
-
-        if (uart_read_byte() == msgClass &&
-            uart_read_byte() == msgId) {
-            return response;
-        } else {
-            return kUbxBadResponse;
-        }
+/**
+ * Fill in sentence rates for only the time sentence (every timeInterval fixes) and, if wanted, GSV
+ */
+static void gps_message_rates(uint8_t* rates, uint8_t timeInterval, bool satellites)
+{
+    for (uint8_t message = 0; message < kNumGpsMessages; ++message) {
+        rates[message] = 0;
     }
-}
 
-// Account for 39.5us delay between top-of-second and complete display update
-#define kTimepulseOffsetNs 39500
-const uint8_t gps_cfg_tp5_data[] = {
-    UBX_VALUE_U8(0), // Timepulse selection (only one available on NEO-6M)
-    UBX_VALUE_U8(0), // Reserved 0
-    UBX_VALUE_U16(0), // Reserved 1
-    UBX_VALUE_S16(50), // Antenna cable delay (nS)
-    UBX_VALUE_S16(0), // RF group delay (readonly)
-    UBX_VALUE_U32(1), // Freqency of time pulse in Hz
-    UBX_VALUE_U32(1), // Freqency of time pulse in Hz when locked to GPS time
-    UBX_VALUE_U32(1000), // Length of time pulse in uS
-    UBX_VALUE_U32(10000), // Length of time pulse in uS when locked to GPS time
-    UBX_VALUE_S32(kTimepulseOffsetNs), // User configurable timepuse delay (nS)
-    UBX_VALUE_U32(0xFF), // All flags set
-};
-
-const uint8_t gps_cfg_nav5_data[] = {
-    UBX_VALUE_U16(0b00111111), // Mask selecting settings to apply
-    UBX_VALUE_U8(2), // "Stationary" dynamic platform model
-    UBX_VALUE_U8(3), // Get either a 3D or 2D fix
-    UBX_VALUE_U32(0), // fixed altitude for 2D
-    UBX_VALUE_U32(0), // fixed altitude variance for 2D
-    UBX_VALUE_U8(20), // minimum elevation is 20 degrees...
-    UBX_VALUE_U8(180), // maximum time to perform dead reckoning in case of GPS signal loss (s)
-    UBX_VALUE_U16(100), // position DoP mask is 10.0...
-    UBX_VALUE_U16(100), // time DoP mask is 10.0...
-    UBX_VALUE_U16(100), // position accuracy mask in meters...
-    UBX_VALUE_U16(100), // time accuracy mask in meters...
-    UBX_VALUE_U8(0), // static hold threshold is 0 cm/s...
-    UBX_VALUE_U8(60), // dynamic GNSS timeout is 60 seconds (not used)...
-    UBX_VALUE_U32(0), // Reserved
-    UBX_VALUE_U32(0), // Reserved
-    UBX_VALUE_U32(0), // Reserved
-};
+    rates[kGpsTimeMessage] = timeInterval;
 
-// ID byte of NMEA messages to enable
-// All messages share the same class byte of 0xF0
-const uint8_t gps_enableMessages[] = {
-    0x03, // GSV (GNSS Satellites in View)
-    0x04, // RMC (Recommended Minimum data)
-};
-
-// ID byte of NMEA messages to disable
-// All messages share the same class byte of 0xF0
-const uint8_t gps_disableMessages[] = {
-    0x0A, // DTM (Datum Reference)
-    0x09, // GBS (GNSS Satellite Fault Detection)
-    0x00, // GGA (Global positioning system fix data)
-    0x01, // GLL (Latitude and longitude, with time of position fix and status)
-    0x40, // GPQ (Poll message)
-    0x06, // GRS (GNSS Range Residuals)
-    0x02, // GSA (GNSS DOP and Active Satellites)
-    0x07, // GST (GNSS Pseudo Range Error Statistics)
-    0x0E, // THS (True Heading and Status)
-    0x41, // TXT (Text Transmission)
-    0x05, // VTG (Course over ground and Ground speed)
-};
+#if CONFIG_GSV_STATUS
+    rates[kGpsMessage_GSV] = satellites ? 1 : 0;
+#endif
+}
 
-void gps_set_nmea_send_rate(const uint8_t rate, const uint8_t* messageIds, const uint8_t length)
+/**
+ * Switch UART1 to one of the baud rates in kGpsBaudRates
+ */
+static void uart_set_baud(uint8_t index)
 {
-    // Buffer for message rate configuration
-    uint8_t cfg_msg_data[3] = {
-        0xF0, // Message class
-        0, // Message ID placeholder
-        rate, // Send rate
-    };
+    _gpsBaudIndex = index;
+    _uartByteTimeUs = 10000000UL / kGpsBaudRates[index];
 
-    // Set send rate to zero to disable messages
-    for (uint8_t i = 0; i < length; ++i) {
-        cfg_msg_data[1] = messageIds[i];
-        ubx_send(0x06, 0x01, cfg_msg_data, sizeof(cfg_msg_data));
-    }
+    // Don't cut off anything still being sent at the old rate
+    while (!uart_send_complete());
+
+    UART1_Init(kGpsBaudRates[index],
+               UART1_WORDLENGTH_8D,
+               UART1_STOPBITS_1,
+               UART1_PARITY_NO,
+               UART1_SYNCMODE_CLOCK_DISABLE,
+               UART1_MODE_TXRX_ENABLE);
 }
 
-// Wait for GPS start-up
+/**
+ * Start configuring the GPS
+ *
+ * This only queues the first message: the rest are sent as the receiver acknowledges each one.
+ */
 void gps_init()
 {
-    // Configure time-pulse
-    ubx_send(0x06, 0x31, gps_cfg_tp5_data, sizeof(gps_cfg_tp5_data));
+    uint8_t rates[kNumGpsMessages];
 
-    // Configure stationary mode
-    ubx_send(0x06, 0x24, gps_cfg_nav5_data, sizeof(gps_cfg_nav5_data));
+    // Enable only the NMEA messages we want to use
+    gps_message_rates(rates, 1, true);
 
-    // Enable NMEA messages we want to use and disable others
-    gps_set_nmea_send_rate(1, gps_enableMessages, sizeof(gps_enableMessages));
-    gps_set_nmea_send_rate(0, gps_disableMessages, sizeof(gps_disableMessages));
+    // Configure the time pulse, navigation and output for the receiver in use
+    gps_driver_init(rates);
 }
 
 inline void spi_send_blocking(uint8_t data)
@@ -257,10 +185,22 @@ static void max7219_cmd(uint8_t address, uint8_t data)
     MAX72XX_PORT->ODR |= MAX72XX_LOAD_PIN;
 }
 
+/**
+ * Make the frame drawn by max7219_set_digit calls the one max7219_write_digits() sends
+ */
+static void max7219_publish_digits()
+{
+    __critical {
+        for (uint8_t i = 0; i < kNumSegments; ++i) {
+            _segmentWiseFrame[i] = _segmentWiseData[i];
+        }
+    }
+}
+
 /**
  * Send complete digit/segment register configuration to the MAX72XX
  *
- * This must be called for max7219_set_digit calls to be shown on the display.
+ * This sends the last frame passed to max7219_publish_digits().
  *
  * All 8 digit (sink) registers need to be set at once as our wiring is flipped in order
  * to drive common anode displays. Each of our phsyical digits is represented by one bit
@@ -268,15 +208,14 @@ static void max7219_cmd(uint8_t address, uint8_t data)
  */
 static void max7219_write_digits()
 {
-    // Block interrupts during display update to avoid contention with the brightness update interrupt
-    disableInterrupts();
-
-    for (uint8_t i = 0; i < kNumSegments; ++i) {
-        const uint8_t digitRegister = i + 1;
-        max7219_cmd(digitRegister, _segmentWiseData[i]);
+    // Block interrupts during display update to avoid contention with other display writes.
+    // This saves and restores the previous interrupt state, so it's safe to use in interrupts.
+    __critical {
+        for (uint8_t i = 0; i < kNumSegments; ++i) {
+            const uint8_t digitRegister = i + 1;
+            max7219_cmd(digitRegister, _segmentWiseFrame[i]);
+        }
     }
-
-    enableInterrupts();
 }
 
 
@@ -368,25 +307,7 @@ static void max7219_init(void)
 }
 
 /**
- * Modify the passed time with the current timezone offset
- */
-static void apply_timezone_offset(DateTime* now)
-{
-    // Adjust hour for timezone
-    int8_t hour = now->hour;
-    hour += _timezoneOffset;
-
-    if (hour > 23) {
-        hour -= 24;
-    } else if (hour < 0) {
-        hour += 24;
-    }
-
-    now->hour = hour;
-}
-
-/**
- * Send the current time to the MAX7219 as 6 BCD digits
+ * Draw a time as 6 BCD digits, shown from the next display update
  */
 static void display_set_buffer(DateTime* now)
 {
@@ -395,19 +316,14 @@ static void display_set_buffer(DateTime* now)
 
     for (int8_t i = 0; i < 3; ++i) {
 
-        // Manually digit into tens and ones columns
-        // This saves 25 bytes vs. using the divide and modulo operators.
-        uint8_t ones = ((uint8_t*) now)[i];
-        uint8_t tens = 0;
-
-        while (ones >= 10) {
-            ones -= 10;
-            ++tens;
-        }
+        // Fields are packed BCD, so each nibble is already a digit
+        const uint8_t value = ((uint8_t*) now)[i];
 
-        max7219_set_digit_bcd(digit++, tens);
-        max7219_set_digit_bcd(digit++, ones);
+        max7219_set_digit_bcd(digit++, value >> 4);
+        max7219_set_digit_bcd(digit++, value & 0x0F);
     }
+
+    max7219_publish_digits();
 }
 
 /**
@@ -424,16 +340,43 @@ static void display_no_signal()
 {
     static uint8_t waitIndicator = 0;
 
-    display_clear();
+    // Value for each digit as passed to max7219_set_digit_bcd (0xF is blank)
+    uint8_t digits[kNumDigits];
+
+    for (uint8_t i = 0; i < kNumDigits; ++i) {
+        digits[i] = 0x0F;
+    }
 
-    // Turn on the decimal point on one digit (digits are 1-indexed)
-    max7219_set_digit_bcd(waitIndicator + 1, 0x8F);
+#if CONFIG_GSV_STATUS
+    // Show the number of satellites in view on the left and the best signal strength on the right
+    // eg. "07  32" for seven satellites with the strongest at 32 dB-Hz
+    const GpsSatellites* satellites = gps_get_satellites();
+
+    if (satellites->inView != 0) {
+        const uint8_t inView = bin_to_bcd(satellites->inView);
+        const uint8_t bestSnr = bin_to_bcd(satellites->bestSnr);
+
+        digits[0] = inView >> 4;
+        digits[1] = inView & 0x0F;
+        digits[4] = bestSnr >> 4;
+        digits[5] = bestSnr & 0x0F;
+    }
+#endif
+
+    // Turn on the decimal point on one digit to indicate activity
+    digits[waitIndicator] |= 0x80;
 
     ++waitIndicator;
     if (waitIndicator == kNumDigits) {
         waitIndicator = 0;
     }
 
+    // Digits are 1-indexed
+    for (uint8_t i = 0; i < kNumDigits; ++i) {
+        max7219_set_digit_bcd(i + 1, digits[i]);
+    }
+
+    max7219_publish_digits();
     max7219_write_digits();
 }
 
@@ -446,9 +389,11 @@ void display_error_code(uint8_t code)
     max7219_set_digit(2, 0b01010000 /* r */);
     max7219_set_digit_bcd(3, code);
 
+    max7219_publish_digits();
     max7219_write_digits();
 }
 
+#if CONFIG_LIGHT_SENSOR
 static inline uint16_t read_adc_buffer()
 {
     // Load ADC reading (least-significant byte must be read first)
@@ -457,18 +402,52 @@ static inline uint16_t read_adc_buffer()
 
     return result;
 }
+#endif
+
+// Intensity last sent to the MAX7219 (set to 0xA during startup)
+static uint8_t _displayBrightness = 0xA;
+
+#if CONFIG_SOLAR_BRIGHTNESS
+// Returned by display_solar_level() when there's no position or time to work from yet
+#define kSolarLevelUnknown 0xFF
 
-static uint8_t _displayBrightness = 0;
+/**
+ * Look up the display intensity for the current time from today's sunrise and sunset
+ */
+static uint8_t display_solar_level(void)
+{
+    // Sunrise and sunset only move by a minute or so a day, so they're calculated once per UTC day
+    static SolarTimes times;
+    static uint8_t calculatedDay = 0; // Day zero never occurs, forcing the first calculation
+
+    const GpsPosition* position = gps_get_position();
+
+    if (!_gpsTimeValid || !position->valid) {
+        return kSolarLevelUnknown;
+    }
+
+    if (calculatedDay != _gpsTime.day) {
+        calculatedDay = _gpsTime.day;
+        solar_calculate(position->latitude, position->longitude, calendar_day_of_year(&_gpsTime), &times);
+    }
+
+    const uint16_t minuteOfDay = (bcd_to_bin(_gpsTime.hour) * 60) + bcd_to_bin(_gpsTime.minute);
+    return solar_brightness(&times, minuteOfDay);
+}
+#endif
 
 void display_adjust_brightness(void)
 {
+    uint8_t level = _displayBrightness;
+
+#if CONFIG_LIGHT_SENSOR
     // State to obtain an average of LDR readings
     // The size of this array should  be a power of two to make division simpler
     static uint16_t averageBuffer[16];
     static uint8_t writeIndex = 0;
     static uint16_t runningTotal = 0;
 
-    const uint16_t reading = read_adc_buffer();
+    const uint16_t reading = _ldrReading;
 
     // Adjust running total with the new value
     runningTotal -= averageBuffer[writeIndex];
@@ -481,28 +460,740 @@ void display_adjust_brightness(void)
     const uint16_t average = runningTotal/COUNT_OF(averageBuffer);
 
     // Scale the 1024 ADC values to fit in the 16 brightness levels of the MAX72XX
-    max7219_cmd(0x0A, average / 64);
+    level = average / 64;
+#endif
+
+#if CONFIG_SOLAR_BRIGHTNESS
+    // The light sensor (if any) can only dim the display below the schedule
+    const uint8_t solarLevel = display_solar_level();
+
+#if CONFIG_LIGHT_SENSOR
+    if (solarLevel < level) {
+        level = solarLevel;
+    }
+#else
+    if (solarLevel != kSolarLevelUnknown) {
+        level = solarLevel;
+    }
+#endif
+#endif
+
+    if (level == _displayBrightness) {
+        return;
+    }
+
+    _displayBrightness = level;
+
+    // Interrupts are blocked so a time pulse can't update the display mid-command
+    __critical {
+        max7219_cmd(0x0A, level);
+    }
 }
 
-void increment_time(DateTime* tim)
+/**
+ * Recalculate the local time after the UTC time or timezone has changed
+ */
+static void update_local_time()
 {
-    ++tim->second;
+    _localTime = _gpsTime;
+    timezone_to_local(&_localTime);
+}
 
-    if (tim->second == 60) {
-        tim->second = 0;
-        ++tim->minute;
+// Number of consecutive fixes agreeing with the counted time before the sentence rate is reduced
+#define kLockFixesRequired 10
+
+// Once locked, the time sentence is only sent every this many seconds to check the count
+#define kLockedTimeInterval 30
+
+// True when the receiver has been told to send the time sentence at the reduced rate
+static bool _gpsLocked = false;
+
+// Number of consecutive fixes that agreed with the time already being counted
+static uint8_t _gpsConsistentFixes = 0;
+
+/**
+ * Change how often the receiver sends sentences
+ *
+ * While the time pulse is healthy and each fix agrees with the counted time, there's no need to
+ * parse a sentence every second: the pulse alone keeps the time. Locked, the time sentence is
+ * only sent every kLockedTimeInterval seconds to verify the count, and GSV is turned off.
+ */
+static void gps_set_locked(bool locked)
+{
+    _gpsLocked = locked;
+    _gpsConsistentFixes = 0;
+
+    uint8_t rates[kNumGpsMessages];
+
+    gps_message_rates(rates, locked ? kLockedTimeInterval : 1, !locked);
+    gps_driver_set_message_rates(rates);
+}
+
+#if CONFIG_GPS_POWER_SAVE
+// Seconds the receiver is left in backup between checks of the time
+#define kGpsSleepSeconds 600
+
+// Seconds allowed after waking for the receiver to confirm the time before power save is abandoned
+#define kGpsWakeTimeout 60
+
+#if kGpsSleepSeconds + kGpsWakeTimeout >= kPpsHoldoverLimit
+#error Holdover stops counting before the receiver is given up on
+#endif
+
+enum GpsPower {
+    kGpsAwake = 0, // Running continuously (power save is only used once locked)
+    kGpsAsleep,    // Held in backup by EXTINT: no pulses or sentences
+    kGpsWaking,    // Released from backup and waiting for a time that agrees with the count
+};
+
+static enum GpsPower _gpsPower = kGpsAwake;
+
+// Seconds until the receiver is next woken, or until waking is given up on
+static uint16_t _gpsPowerCountdown = 0;
+
+/**
+ * Hold the receiver in backup and count seconds from the measured pulse period until it's next woken
+ *
+ * Nothing happens until the receiver has accepted the power save configuration this asks for, so
+ * this is tried again with each consistent fix while locked.
+ */
+static void gps_sleep(void)
+{
+    // Power save is only configured once it's needed, so acquisition always runs at full power
+    if (!ubx_configure_power_save()) {
+        return;
+    }
+
+    __critical {
+        pps_set_holdover(true);
+    }
+
+    GPS_PORT->ODR &= ~GPS_PIN_EXTINT;
+
+    _gpsPower = kGpsAsleep;
+    _gpsPowerCountdown = kGpsSleepSeconds;
+}
+
+/**
+ * Release the receiver from backup so the time can be checked (holdover continues until it is)
+ */
+static void gps_wake(void)
+{
+    GPS_PORT->ODR |= GPS_PIN_EXTINT;
+
+    _gpsPower = kGpsWaking;
+    _gpsPowerCountdown = kGpsWakeTimeout;
+}
+
+/**
+ * Keep the receiver running and stop counting seconds without it
+ */
+static void gps_stay_awake(void)
+{
+    GPS_PORT->ODR |= GPS_PIN_EXTINT;
+
+    __critical {
+        pps_set_holdover(false);
+    }
+
+    _gpsPower = kGpsAwake;
+}
+#endif
+
+/**
+ * Return to the full sentence rate (if reduced) and start counting consistent fixes again
+ */
+static void gps_unlock(void)
+{
+#if CONFIG_GPS_POWER_SAVE
+    if (_gpsPower != kGpsAwake) {
+        gps_stay_awake();
+    }
+#endif
+
+    if (_gpsLocked) {
+        gps_set_locked(false);
+    }
+
+    _gpsConsistentFixes = 0;
+}
+
+/**
+ * Work out how many seconds after the time in the last sentence the next time pulse will be
+ *
+ * A sentence's time is for a fix made just before the sentence started sending, so the time pulse
+ * before the sentence started marks the start of that second. If the last pulse arrived later than
+ * that (the sentence straddled a pulse, or was slow to be read), it's already the next second.
+ */
+static uint8_t gps_seconds_to_next_pulse(void)
+{
+    const GpsSentenceTiming* timing = gps_get_timing();
+
+    uint32_t lastEdge;
+    uint16_t edgeCount;
+
+    __critical {
+        lastEdge = pps_stats.lastEdge;
+        edgeCount = pps_stats.count;
+    }
+
+    // Without knowing when the sentence arrived, assume it was in the second it describes
+    if (!timing->endValid) {
+        return 1;
+    }
+
+    // Estimate when the sentence started arriving from its length
+    const uint32_t sentenceStart = timing->end - ((uint32_t) timing->length * _uartByteTimeUs);
+    const int32_t sinceEdge = (int32_t) (sentenceStart - lastEdge);
+
+    // Without a recent pulse, assume the sentence arrived in the second it describes
+    // A pulse can only follow the sentence's start by as long as the sentence took to be read, so
+    // one further away than a second either side doesn't belong to this sentence.
+    if (edgeCount == 0 ||
+        sinceEdge > (int32_t) (kPpsNominalPeriod + kPpsWindow) ||
+        sinceEdge < -(int32_t) (kPpsNominalPeriod + kPpsWindow)) {
+        return 1;
+    }
+
+    // The fix can't have been made after the sentence started, so if the sentence started
+    // earlier into the pulse's second than its fractional time, the pulse is for the next second
+    if (sinceEdge < (int32_t) timing->milliseconds * 1000) {
+        return 2;
+    }
+
+    return 1;
+}
+
+#if CONFIG_UBX_TIMEPULSE
+// Seconds the time from TIM-TP is preferred over NMEA times after the last one arrived
+#define kPulseTimeTimeout 2
+
+// Seconds since a TIM-TP message was read (counted up to kPulseTimeTimeout by the supervisor)
+static uint8_t _pulseTimeAge = kPulseTimeTimeout;
+#endif
+
+/**
+ * Return true if the time of each pulse is being read directly from the receiver (UBX TIM-TP)
+ */
+static inline bool gps_pulse_time_current(void)
+{
+#if CONFIG_UBX_TIMEPULSE
+    return _pulseTimeAge < kPulseTimeTimeout;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Set the time to show at the next time pulse, if it differs from the time being counted
+ */
+static void gps_apply_time(const DateTime* newTime)
+{
+    // Sentences and TIM-TP can't express an inserted leap second (23:59:60), so around one they
+    // don't reliably agree with the count. The count already follows the schedule, so keep it.
+    if (_gpsTimeValid && (_gpsTime.second == 0x60 || newTime->second == 0x60)) {
+        return;
+    }
+
+    // Nothing needs recalculating if this agrees with the time we're already counting
+    if (!_gpsTimeValid || calendar_compare(newTime, &_gpsTime) != 0) {
+        // Any disagreement means the count can't be trusted to run by itself
+        gps_unlock();
+
+        _gpsTime = *newTime;
+        _gpsTimeValid = true;
+
+        timezone_recalculate(&_gpsTime);
+        update_local_time();
+        display_set_buffer(&_localTime);
+
+    } else if (!_gpsLocked) {
+        ++_gpsConsistentFixes;
+
+        if (_gpsConsistentFixes == kLockFixesRequired) {
+            gps_set_locked(true);
+
+#if CONFIG_GPS_POWER_SAVE
+            gps_sleep();
+#endif
+        }
+    }
+#if CONFIG_GPS_POWER_SAVE
+    else if (_gpsPower != kGpsAsleep) {
+        // The count held while the receiver was asleep (or it's still waiting for power save to be
+        // configured), so it can go straight back to sleep
+        gps_sleep();
     }
+#endif
+}
 
-    if (tim->minute == 60) {
-        tim->minute = 0;
-        ++tim->hour;
+/**
+ * Work out the time of the next pulse from the time in an NMEA sentence and apply it
+ */
+static void gps_use_sentence_time(DateTime* newTime)
+{
+    // The pulse time from the receiver is exact, so there's nothing to gain from guessing
+    if (gps_pulse_time_current()) {
+        return;
+    }
+
+    // The weekday only needs working out from scratch when the date has changed
+    if (newTime->day == _gpsTime.day &&
+        newTime->month == _gpsTime.month &&
+        newTime->year == _gpsTime.year) {
+        newTime->weekday = _gpsTime.weekday;
+    } else {
+        newTime->weekday = calendar_weekday(newTime);
     }
 
-    if (tim->hour == 24) {
-        tim->hour = 0;
+    // Prepare the value to be sent at the next time pulse from the GPS
+    // This follows any leap second, which a plain increment would step over
+    for (uint8_t seconds = gps_seconds_to_next_pulse(); seconds != 0; --seconds) {
+        leap_next_second(newTime);
     }
+
+    gps_apply_time(newTime);
+}
+
+/**
+ * Save the timezone and the GPS baud rate (nothing is written if they haven't changed)
+ */
+static void save_settings(void)
+{
+    const Settings settings = {
+        .zone = timezone_get_zone(),
+        .dstModeAndBaud = SETTINGS_DST_MODE_AND_BAUD(timezone_get_dst_mode(), _gpsBaudIndex),
+    };
+
+    settings_save(&settings);
 }
 
+/**
+ * Consume received bytes and act on any sentences completed by them
+ */
+static void task_gps_parse(void)
+{
+    DateTime newTime;
+    GpsReadStatus status;
+
+    while ((status = gps_read_time(&newTime)) != kGPS_Incomplete) {
+        // Statuses up to kGPS_Satellites are only returned once a checksum has been verified
+        if (!_gpsBaudFound && status <= kGPS_Satellites) {
+            _gpsBaudFound = true;
+
+            // Remember the rate for next time, then configure the receiver now it can hear us
+            save_settings();
+            gps_init();
+        }
+
+        switch (status) {
+            case kGPS_Success:
+                gps_use_sentence_time(&newTime);
+
+#if CONFIG_AUTO_TIMEZONE
+                // Follow the timezone of the current position (only looked up after moving)
+                {
+                    TzZone zone;
+
+                    if (tzindex_update(gps_get_position(), &zone)) {
+                        timezone_set_auto(zone.offset, zone.dstMode, &_gpsTime);
+                        update_local_time();
+                        display_set_buffer(&_localTime);
+                    }
+                }
+#endif
+
+                _gpsSentenceSeen = true;
+                break;
+
+#if CONFIG_UBX_TIMEPULSE
+            case kGPS_PulseTime:
+                // This is the time the next pulse marks, so it can be used as-is
+                pps_stats.quantisationError = gps_get_timing()->quantisationError;
+                _pulseTimeAge = 0;
+
+                gps_apply_time(&newTime);
+                _gpsSentenceSeen = true;
+                break;
+#endif
+
+            case kGPS_UbxFrame:
+#if CONFIG_LEAP_SECONDS
+                {
+                    UbxLeapSeconds leapSeconds;
+
+                    if (_gpsTimeValid && ubx_decode_nav_timels(ubx_get_frame(), &leapSeconds)) {
+                        leap_schedule(&_gpsTime, leapSeconds.secondsToEvent, leapSeconds.change);
+                    }
+                }
+#endif
+#if !CONFIG_GPS_MTK
+                // Receiver configuration carries on as each message is acknowledged
+                ubx_handle_ack(ubx_get_frame());
+#endif
+                _gpsSentenceSeen = true;
+                break;
+
+            case kGPS_Satellites:
+                // Satellite details are only shown by display_no_signal() while waiting for a fix
+                _gpsSentenceSeen = true;
+                break;
+
+            case kGPS_TimeOnly:
+                // The date only comes from RMC or ZDA, so this is just a sign of life (GGA is
+                // still worth reading for its position)
+                _gpsSentenceSeen = true;
+                break;
+
+            case kGPS_NoMatch:
+            case kGPS_Truncated:
+                // Ignore partial and unknown sentences
+                // A cut-off sentence isn't shown as an error as the next one will be complete
+                break;
+
+            case kGPS_NoSignal:
+                _gpsSentenceSeen = true;
+
+                // The receiver can know the time without a position fix
+                if (gps_pulse_time_current()) {
+                    break;
+                }
+
+                // Walk the decimal point across the display to indicate activity
+                display_no_signal();
+                _gpsTimeValid = false;
+                gps_unlock();
+                break;
+
+            case kGPS_InvalidChecksum:
+                display_error_code(1);
+                break;
+
+            case kGPS_BadFormat:
+                // This state is returned if the UART line isn't pulled high (ie. GPS unplugged)
+                display_error_code(2);
+                break;
+
+            case kGPS_UnknownState:
+                // This state is returned if the UART line isn't pulled high (ie. GPS unplugged)
+                display_error_code(3);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+/**
+ * Advance to the next second after a time pulse and prepare the following frame
+ */
+static void task_display(void)
+{
+    if (_ppsTicked) {
+        _ppsTicked = false;
+        leap_increment_second(&_gpsTime, &_localTime);
+
+        // Daylight saving changes are rare, so the local time is only rebuilt when one happens
+        if (timezone_check_transition(&_gpsTime)) {
+            update_local_time();
+        }
+    }
+
+    if (_gpsTimeValid) {
+        display_set_buffer(&_localTime);
+    }
+}
+
+static Button _buttonTimezone;
+static Button _buttonDst;
+
+// Ticks to wait after the last button press before saving settings (writes are deferred so
+// stepping through options doesn't wear the EEPROM)
+#define kSettingsSaveDelay (3 * kTimebaseTicksPerSecond)
+static uint16_t _settingsSaveCountdown = 0;
+
+/**
+ * Sample buttons and act on new presses (runs every timebase tick)
+ */
+static void task_buttons(void)
+{
+    // Buttons pull to ground when pressed
+    const uint8_t sample = ~BUTTON_PORT->IDR;
+
+    const ButtonEvent timezoneEvent = button_update(&_buttonTimezone, sample & BUTTON_PIN_TIMEZONE);
+    const ButtonEvent dstEvent = button_update(&_buttonDst, sample & BUTTON_PIN_DST);
+
+    if (timezoneEvent == kButton_None && dstEvent == kButton_None) {
+        // Save changes once both buttons have been left alone
+        if (_settingsSaveCountdown != 0 && !_buttonTimezone.pressed && !_buttonDst.pressed) {
+            --_settingsSaveCountdown;
+
+            if (_settingsSaveCountdown == 0) {
+                save_settings();
+            }
+        }
+
+        return;
+    }
+
+    uint8_t zone = timezone_get_zone();
+    uint8_t dstMode = timezone_get_dst_mode();
+
+    // Timezone button steps forward through UTC-12:00 to UTC+14:00 (then automatic, if enabled),
+    // repeating while held
+    if (timezoneEvent != kButton_None) {
+        ++zone;
+        if (zone == kNumZoneChoices) {
+            zone = 0;
+        }
+    }
+
+    if (dstEvent == kButton_Short) {
+        // Cycle through off, on, and each automatic rule
+        ++dstMode;
+        if (dstMode == kNumDstModes) {
+            dstMode = kDstMode_Off;
+        }
+    } else if (dstEvent != kButton_None) {
+        // Holding the DST button steps backward through the timezones
+        zone = (zone == 0) ? kNumZoneChoices - 1 : zone - 1;
+    }
+
+    timezone_select(zone, dstMode, &_gpsTime);
+    update_local_time();
+
+    sched_set_ready(kTask_Display);
+    _settingsSaveCountdown = kSettingsSaveDelay;
+}
+
+/**
+ * Show the prepared frame now for a second counted without a time pulse
+ */
+static void display_tick(void)
+{
+    max7219_write_digits();
+    _ppsTicked = true;
+    sched_set_ready(kTask_Display);
+}
+
+// Seconds to listen at each baud rate for a valid sentence (the GPS sends a burst once a second)
+#define kGpsProbeSeconds 2
+
+/**
+ * Move on to the next baud rate if nothing valid has been heard at this one (runs once per second)
+ *
+ * The parse task stops the search when a sentence or UBX frame passes its checksum, so noise
+ * from a mismatched rate can't be mistaken for data. Rates are tried starting with the one
+ * used last time.
+ */
+static void gps_probe_baud(void)
+{
+    static uint8_t seconds = 0;
+    static uint8_t ratesTried = 0;
+
+    ++seconds;
+    if (seconds < kGpsProbeSeconds) {
+        return;
+    }
+
+    seconds = 0;
+
+    ++ratesTried;
+    if (ratesTried == COUNT_OF(kGpsBaudRates)) {
+        // Nothing was heard at any rate (ie. GPS unplugged), so keep going round
+        ratesTried = 0;
+        display_error_code(4);
+    }
+
+    uart_set_baud((_gpsBaudIndex + 1 == COUNT_OF(kGpsBaudRates)) ? 0 : _gpsBaudIndex + 1);
+}
+
+/**
+ * Return true if the time pulse hasn't arrived when it was due
+ *
+ * This is measured from the last edge rather than sampled each second, as the timebase isn't
+ * locked to the pulse: a fast oscillator can run two checks between the same pair of pulses.
+ */
+static bool gps_pulse_overdue(void)
+{
+    bool overdue;
+
+    __critical {
+        overdue = pps_overdue(timebase_now());
+    }
+
+    return overdue;
+}
+
+/**
+ * Check the GPS is still sending data and time pulses (runs once per second)
+ */
+static void task_gps_supervisor(void)
+{
+    // Seconds allowed without any complete sentence before the GPS is considered disconnected
+    // This is longer when locked as sentences are deliberately sent less often
+    const uint8_t kSentenceTimeout = 3;
+    const uint8_t timeout = _gpsLocked ? (kLockedTimeInterval + kSentenceTimeout) : kSentenceTimeout;
+
+    static uint8_t secondsSinceSentence = 0;
+
+    // Nothing else can be checked until the GPS is heard at the right baud rate
+    if (!_gpsBaudFound) {
+        gps_probe_baud();
+        return;
+    }
+
+#if !CONFIG_GPS_MTK
+    ubx_config_retry();
+#endif
+
+#if CONFIG_GPS_POWER_SAVE
+    if (_gpsPower != kGpsAwake) {
+        --_gpsPowerCountdown;
+
+        if (_gpsPower == kGpsAsleep) {
+            if (_gpsPowerCountdown == 0) {
+                gps_wake();
+            }
+
+            // Nothing is sent while asleep, and holdover keeps the time
+            _gpsSentenceSeen = false;
+            secondsSinceSentence = 0;
+            return;
+        }
+
+        if (_gpsPowerCountdown == 0) {
+            // The time couldn't be confirmed after waking, so go back to running continuously
+            gps_unlock();
+        } else if (gps_pulse_overdue()) {
+            // Holdover keeps the time until the pulse is back
+            return;
+        }
+    }
+#endif
+
+    if (_gpsSentenceSeen) {
+        _gpsSentenceSeen = false;
+        secondsSinceSentence = 0;
+    } else if (secondsSinceSentence < timeout) {
+        ++secondsSinceSentence;
+
+        if (secondsSinceSentence == timeout) {
+            // Nothing is being received (ie. GPS unplugged or talking at the wrong baud rate)
+            display_error_code(4);
+        }
+    }
+
+#if CONFIG_UBX_TIMEPULSE
+    if (_pulseTimeAge < kPulseTimeTimeout) {
+        ++_pulseTimeAge;
+    }
+#endif
+
+#if CONFIG_SOLAR_BRIGHTNESS
+    // Follow the brightness schedule once a second
+    sched_set_ready(kTask_Brightness);
+#endif
+
+    // Keep the clock running from this task if the time pulse has stopped
+    if (!gps_pulse_overdue()) {
+        return;
+    }
+
+    // Without the pulse, sentences are needed every second to keep the time right
+    gps_unlock();
+
+    if (_gpsTimeValid && secondsSinceSentence < timeout) {
+        display_tick();
+    }
+}
+
+// Timebase ticks each outline segment is lit for by the start-up self-test
+#define kSelfTestStepTicks 5
+
+// Segment register lit by the self-test
+static uint8_t _selfTestSegment = 0;
+
+/**
+ * Return true if the display still shows only the segment lit by the self-test
+ */
+static bool self_test_showing(void)
+{
+    for (uint8_t i = 0; i < kNumSegments; ++i) {
+        if (_segmentWiseData[i] != ((i == _selfTestSegment) ? 0xFF : 0x00)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Illuminate each of the outline segments one at a time at start-up (runs every timebase tick)
+ *
+ * This runs alongside finding and configuring the GPS. It stops early, leaving the display alone,
+ * once anything else (the time, no signal or an error) has been drawn.
+ */
+static void task_self_test(void)
+{
+    static uint8_t ticks = 0;
+
+    ++ticks;
+    if (ticks < kSelfTestStepTicks) {
+        return;
+    }
+
+    ticks = 0;
+
+    if (!self_test_showing()) {
+        timebase_end_self_test();
+        return;
+    }
+
+    _segmentWiseData[_selfTestSegment] = 0x00;
+    ++_selfTestSegment;
+
+    if (_selfTestSegment < kNumDigits) {
+        _segmentWiseData[_selfTestSegment] = 0xFF;
+    } else {
+        timebase_end_self_test();
+    }
+
+    max7219_publish_digits();
+    max7219_write_digits();
+}
+
+#if CONFIG_GPS_POWER_SAVE
+/**
+ * Show each second counted while the receiver is asleep (runs every timebase tick)
+ */
+static void task_holdover(void)
+{
+    bool due;
+
+    __critical {
+        due = pps_holdover_due(timebase_now());
+    }
+
+    if (due) {
+        display_tick();
+    }
+}
+#endif
+
+const TaskFunc sched_tasks[kNumTasks] = {
+    /* kTask_GpsParse: */ task_gps_parse,
+    /* kTask_Display: */ task_display,
+    /* kTask_Buttons: */ task_buttons,
+    /* kTask_Brightness: */ display_adjust_brightness,
+    /* kTask_GpsSupervisor: */ task_gps_supervisor,
+    /* kTask_SelfTest: */ task_self_test,
+#if CONFIG_GPS_POWER_SAVE
+    /* kTask_Holdover: */ task_holdover,
+#endif
+};
+
 int main()
 {
     // Configure the clock for maximum speed on the 16MHz HSI oscillator
@@ -518,11 +1209,24 @@ int main()
     TEST_PIN_PORT->CR1 = TEST_PIN_1 | TEST_PIN_2; // Push-pull mode
     TEST_PIN_PORT->ODR = TEST_PIN_1 | TEST_PIN_2; // Pull high
 
+#if CONFIG_PPS_CAPTURE
+    // Timepulse from GPS is timestamped by TIM2 input capture
+    PPS_CAPTURE_PORT->DDR &= ~PPS_CAPTURE_PIN; // Input mode
+    PPS_CAPTURE_PORT->CR1 |= PPS_CAPTURE_PIN;  // Enable internal pull-up
+#else
     // Interrupt outputs from GPS as inputs
     EXTI->CR1 |= 0x04; // Rising edge triggers interrupt
     GPS_PORT->DDR &= ~GPS_PIN_TIMEPULSE; // Input mode
     GPS_PORT->CR1 |= GPS_PIN_TIMEPULSE;  // Enable internal pull-up
     GPS_PORT->CR2 |= GPS_PIN_TIMEPULSE;  // Interrupt enabled
+#endif
+
+#if CONFIG_GPS_POWER_SAVE
+    // EXTINT keeps the receiver awake while high and in backup while low
+    // B5 is a true open-drain pin, so high comes from the receiver's own pull-up
+    GPS_PORT->ODR |= GPS_PIN_EXTINT; // Released
+    GPS_PORT->DDR |= GPS_PIN_EXTINT; // Output mode
+#endif
 
     BUTTON_PORT->DDR &= ~(BUTTON_PIN_DST | BUTTON_PIN_TIMEZONE); // Input mode
     BUTTON_PORT->CR1 |= BUTTON_PIN_DST | BUTTON_PIN_TIMEZONE; // Enable internal pull-up
@@ -553,17 +1257,15 @@ int main()
     SPI_Cmd(ENABLE);
 
     // Enable UART for GPS comms
-    UART1_Init(9600, // Baud rate
-               UART1_WORDLENGTH_8D,
-               UART1_STOPBITS_1,
-               UART1_PARITY_NO,
-               UART1_SYNCMODE_CLOCK_DISABLE,
-               UART1_MODE_TXRX_ENABLE);
+    // This starts at the default rate: the rate the GPS is really using is found after start-up
+    uart_set_baud(0);
 
     UART1_ITConfig(UART1_IT_RXNE_OR, ENABLE);
+    UART1_ITConfig(UART1_IT_IDLE, ENABLE);
     UART1_Cmd(ENABLE);
 
 
+#if CONFIG_LIGHT_SENSOR
     // Enable ADC for ambient light sensing
     // Conversion is triggered by timer 1's TRGO event
     ADC1->CSR = ADC1_CSR_EOCIE | // Enable interrupt at end of conversion
@@ -581,7 +1283,11 @@ int main()
     TIM1->PSCRH = (tim1_prescaler >> 8);
     TIM1->PSCRL = (tim1_prescaler & 0xFF);
 
+#if CONFIG_SOLAR_BRIGHTNESS
+    const uint16_t tim1_auto_reload = 999; // Number of milliseconds to count to (the LDR is only a correction)
+#else
     const uint16_t tim1_auto_reload = 69; // Number of milliseconds to count to
+#endif
     TIM1->ARRH = (tim1_auto_reload >> 8);
     TIM1->ARRL = (tim1_auto_reload & 0xFF);
 
@@ -598,104 +1304,243 @@ int main()
     TIM1->EGR |= TIM1_EGR_UG; // Generate an update event to register new settings
 
     TIM1->CR1 = TIM1_CR1_CEN; // Enable the counter
+#endif
+
+    // Start the microsecond timebase used to schedule tasks and timestamp the time pulse
+    timebase_init();
+
+#if CONFIG_PPS_CAPTURE
+    timebase_enable_capture();
+#endif
+
+    // Set interrupt priorities so the time pulse is never delayed by another handler and
+    // received bytes are handled ahead of housekeeping. Higher levels can interrupt lower ones.
+    // These can only be changed while interrupts are disabled (as they are from reset).
+#if CONFIG_PPS_CAPTURE
+    ITC_SetSoftwarePriority(ITC_IRQ_TIM2_CAPCOM, ITC_PRIORITYLEVEL_3);
+#else
+    ITC_SetSoftwarePriority(ITC_IRQ_PORTB, ITC_PRIORITYLEVEL_3);
+#endif
+    ITC_SetSoftwarePriority(ITC_IRQ_UART1_RX, ITC_PRIORITYLEVEL_2);
+    ITC_SetSoftwarePriority(ITC_IRQ_UART1_TX, ITC_PRIORITYLEVEL_1);
+    ITC_SetSoftwarePriority(ITC_IRQ_TIM2_OVF, ITC_PRIORITYLEVEL_1);
+#if CONFIG_LIGHT_SENSOR
+    ITC_SetSoftwarePriority(ITC_IRQ_ADC1, ITC_PRIORITYLEVEL_1);
+#endif
 
     enableInterrupts();
 
     max7219_init();
+
+    // Light the first outline segment: task_self_test() steps through the rest
+    _segmentWiseData[0] = 0xFF;
+    max7219_publish_digits();
     max7219_write_digits();
 
-    max7219_cmd(0x0A, 0xA);
+    max7219_cmd(0x0A, _displayBrightness);
 
-    // Illuminate each of the outline segments one at a time
-    for (uint8_t i = 0; i < kNumDigits; ++i) {
-        _segmentWiseData[i] = 0xFF;
-        max7219_write_digits();
+    // Restore the timezone chosen and GPS baud rate found before the last power off
+    {
+        Settings settings = {
+            .zone = kDefaultTimezone,
+            .dstModeAndBaud = SETTINGS_DST_MODE_AND_BAUD(kDefaultDstMode, 0),
+        };
+
+        // Fall back to the defaults if the saved values are no longer in range
+        if (!settings_load(&settings) ||
+            settings.zone >= kNumZoneChoices ||
+            settings_get_dst_mode(&settings) >= kNumDstModes) {
+            settings.zone = kDefaultTimezone;
+            settings.dstModeAndBaud = SETTINGS_DST_MODE_AND_BAUD(kDefaultDstMode, 0);
+        }
+
+        timezone_select(settings.zone, settings_get_dst_mode(&settings), &_gpsTime);
 
-        _segmentWiseData[i] = 0x00;
-        _delay_ms(50);
+        // Listen at the last rate the GPS used first. The GPS is configured once it's heard.
+        const uint8_t savedBaud = settings_get_gps_baud(&settings);
+        uart_set_baud((savedBaud < COUNT_OF(kGpsBaudRates)) ? savedBaud : 0);
     }
 
-    max7219_write_digits();
+    sched_run();
+}
 
-    gps_init();
+volatile static CircBuf _uartBuffer;
 
-    while (true) {
-        // Wait for a line of text from the GPS unit
-        DateTime newTime;
-        const GpsReadStatus status = gps_read_time(&newTime);
+// Bytes waiting to be sent to the GPS, drained by the transmit interrupt
+volatile static CircBuf _uartTxBuffer;
 
-        switch (status) {
-            case kGPS_Success:
-                // Prepare the value to be sent at the next time pulse from the GPS
-                apply_timezone_offset(&newTime);
-                increment_time(&newTime);
+void uart_send(const uint8_t* bytes, uint16_t length)
+{
+    while (length > 0) {
+        // Wait for the interrupt to make room if the buffer is full
+        while (circbuf_count(&_uartTxBuffer) == kCircBufSize - 1);
 
-                _gpsPreparingNextTime = true;
+        circbuf_append(&_uartTxBuffer, *bytes);
 
-                display_set_buffer(&newTime);
-                _gpsTime = newTime;
+        // Interrupt whenever the data register is empty until the buffer is drained
+        UART1->CR2 |= UART1_CR2_TIEN;
 
-                _gpsPreparingNextTime = false;
-                break;
+        --length;
+        ++bytes;
+    }
+}
 
-            case kGPS_NoMatch:
-                // Ignore partial and unknown sentences
-                break;
+bool uart_send_complete(void)
+{
+    return circbuf_is_empty(&_uartTxBuffer) && (UART1->SR & UART1_SR_TC);
+}
 
-            case kGPS_NoSignal:
-                // Walk the decimal point across the display to indicate activity
-                display_no_signal();
-                break;
+uint8_t uart_peek(const char** bytes)
+{
+    *bytes = (const char*) circbuf_peek(&_uartBuffer);
+    return circbuf_contiguous(&_uartBuffer);
+}
 
-            case kGPS_InvalidChecksum:
-                display_error_code(1);
-                break;
+void uart_consume(uint8_t count)
+{
+    circbuf_commit(&_uartBuffer, count);
+}
 
-            case kGPS_BadFormat:
-                // This state is returned if the UART line isn't pulled high (ie. GPS unplugged)
-                display_error_code(2);
-                break;
+// Number of '*' bytes timestamped by the receive interrupt (a power of two)
+// UBX frames can contain '*' too, so this is more than the number of sentences the buffer can hold.
+#define kUartMarkSlots 8
 
-            case kGPS_UnknownState:
-                // This state is returned if the UART line isn't pulled high (ie. GPS unplugged)
-                display_error_code(3);
-                break;
+/**
+ * A '*' in the receive buffer and when it arrived, marking the end of a sentence's data
+ */
+typedef struct UartMark {
+    // Position in _uartBuffer
+    uint8_t index;
+
+    // Timebase timestamp
+    uint32_t time;
+} UartMark;
+
+static volatile UartMark _uartMarks[kUartMarkSlots];
+
+// Slot the next mark is written to, overwriting the oldest
+static volatile uint8_t _uartMarkNext = 0;
+
+bool uart_received_time(const char* byte, uint32_t* time)
+{
+    const uint8_t index = (const uint8_t*) byte - (const uint8_t*) _uartBuffer.data;
+    bool found = false;
+
+    // Search newest first: any older mark at the same position is from an earlier pass of the buffer
+    __critical {
+        uint8_t slot = _uartMarkNext;
+
+        for (uint8_t n = 0; n < kUartMarkSlots && !found; ++n) {
+            slot = (slot - 1) & (kUartMarkSlots - 1);
+
+            if (_uartMarks[slot].index == index) {
+                *time = _uartMarks[slot].time;
+                found = true;
+            }
         }
     }
+
+    return found;
 }
 
-volatile static CircBuf _uartBuffer;
+// Wake the parser early if this many bytes are waiting without a complete line
+#define kUartWakeThreshold (kCircBufSize / 2)
 
-char uart_read_byte(void)
+void uart1_receive_irq(void) __interrupt(ITC_IRQ_UART1_RX)
 {
-    // Block until a character is available
-    while (circbuf_is_empty(&_uartBuffer));
+    // Reading the status register then the data register clears both the RXNE and IDLE flags
+    const uint8_t status = UART1->SR;
+    const uint8_t byte = ((uint8_t) UART1->DR);
+
+    if (status & UART1_SR_RXNE) {
+        // Timestamp the end of each sentence so its time can be matched to a time pulse
+        if (byte == '*') {
+            volatile UartMark* mark = &_uartMarks[_uartMarkNext];
 
-    return circbuf_pop(&_uartBuffer);
+            mark->index = _uartBuffer.writeIndex;
+            mark->time = timebase_now();
+            _uartMarkNext = (_uartMarkNext + 1) & (kUartMarkSlots - 1);
+        }
+
+        circbuf_append(&_uartBuffer, byte);
+
+        // Only wake the parser once a line is complete, so it runs once per sentence rather
+        // than once per byte. It's also woken if the buffer is filling up without a newline.
+        if (byte == '\n' || circbuf_count(&_uartBuffer) >= kUartWakeThreshold) {
+            sched_set_ready(kTask_GpsParse);
+        }
+    }
+
+    // The line has gone quiet after receiving: wake the parser for anything that doesn't end in
+    // a newline (eg. UBX frames, or a sentence cut short by the GPS being unplugged)
+    if (status & UART1_SR_IDLE) {
+        sched_set_ready(kTask_GpsParse);
+    }
 }
 
-void uart1_receive_irq(void) __interrupt(ITC_IRQ_UART1_RX)
+void uart1_transmit_irq(void) __interrupt(ITC_IRQ_UART1_TX)
 {
-    const uint8_t byte = ((uint8_t) UART1->DR);
+    if (circbuf_is_empty(&_uartTxBuffer)) {
+        // Everything has been sent: stop interrupting on an empty data register
+        UART1->CR2 &= ~UART1_CR2_TIEN;
+        return;
+    }
 
-    circbuf_append(&_uartBuffer, byte);
+    // Writing the data register clears the TXE flag
+    UART1->DR = circbuf_pop(&_uartTxBuffer);
 }
 
-void gps_irq(void) __interrupt(ITC_IRQ_PORTB)
+/**
+ * Show the prepared frame on a time pulse, unless the edge is rejected as a glitch
+ */
+static inline void pps_handle_edge(uint32_t timestamp, uint16_t latency)
 {
+    if (!pps_record_edge(timestamp, latency)) {
+        return;
+    }
+
+    // Test pin 1 is held low while the display is latched so the delay and jitter from the
+    // time pulse edge to the display update can be measured with a scope
+    TEST_PIN_PORT->ODR &= ~TEST_PIN_1;
     max7219_write_digits();
+    TEST_PIN_PORT->ODR |= TEST_PIN_1;
 
-    // Prepare the next update if it's not already being written by the main loop
-    if (!_gpsPreparingNextTime) {
-        increment_time(&_gpsTime);
-        display_set_buffer(&_gpsTime);
-    }
+    // Prepare the next update in the main loop
+    _ppsTicked = true;
+    sched_set_ready(kTask_Display);
 }
 
+#if CONFIG_PPS_CAPTURE
+void gps_capture_irq(void) __interrupt(ITC_IRQ_TIM2_CAPCOM)
+{
+    // Reading the least-significant byte of the capture also clears the interrupt flag
+    uint16_t capture = TIM2->CCR1H << 8;
+    capture |= TIM2->CCR1L;
+
+    uint16_t latency;
+    const uint32_t timestamp = timebase_capture_time(capture, &latency);
+
+    pps_handle_edge(timestamp, latency);
+}
+#else
+void gps_irq(void) __interrupt(ITC_IRQ_PORTB)
+{
+    // Timestamp is taken in software, so latency can't be measured here
+    pps_handle_edge(timebase_now(), 0);
+}
+#endif
+
+#if CONFIG_LIGHT_SENSOR
 void adc_irq(void) __interrupt(ITC_IRQ_ADC1)
 {
     // Clear the end of conversion bit so this interrupt can fire again
     ADC1->CSR &= ~ADC1_CSR_EOC;
 
-    display_adjust_brightness();
-}
\ No newline at end of file
+    _ldrReading = read_adc_buffer();
+
+#if !CONFIG_SOLAR_BRIGHTNESS
+    // With a brightness schedule, the supervisor runs the brightness task instead
+    sched_set_ready(kTask_Brightness);
+#endif
+}
+#endif
\ No newline at end of file
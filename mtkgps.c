@@ -0,0 +1,76 @@
+#include "gpsdriver.h"
+
+#if CONFIG_GPS_MTK
+
+// Field of the PMTK314 (set NMEA output) command for each GpsMessage
+static const uint8_t kPmtk314Fields[kNumGpsMessages] = {
+    /* kGpsMessage_GGA: */ 3,
+    /* kGpsMessage_GLL: */ 0,
+    /* kGpsMessage_GSA: */ 4,
+    /* kGpsMessage_GSV: */ 5,
+    /* kGpsMessage_RMC: */ 1,
+    /* kGpsMessage_VTG: */ 2,
+    /* kGpsMessage_GRS: */ 6,
+    /* kGpsMessage_GST: */ 7,
+    /* kGpsMessage_ZDA: */ 17,
+};
+
+// Number of rate fields PMTK314 takes (unlisted ones are reserved or MediaTek specific)
+#define kPmtk314NumFields 19
+
+// PMTK314 rates are a single digit: a sentence can be sent at most every 5 fixes
+#define kPmtkMaxRate 5
+
+/**
+ * Send a PMTK command, given as the text between the '$' and the checksum
+ *
+ * Commands aren't waited for: the receiver's PMTK001 acknowledgement is ignored by the parser.
+ */
+static void mtk_send(const char* command, uint8_t length)
+{
+    const char kHexDigits[] = "0123456789ABCDEF";
+    uint8_t checksum = 0;
+
+    for (uint8_t i = 0; i < length; ++i) {
+        checksum ^= command[i];
+    }
+
+    const uint8_t end[] = {'*', kHexDigits[checksum >> 4], kHexDigits[checksum & 0x0F], '\r', '\n'};
+
+    uart_send((const uint8_t*) "$", 1);
+    uart_send((const uint8_t*) command, length);
+    uart_send(end, sizeof(end));
+}
+
+void gps_driver_init(const uint8_t* rates)
+{
+    // Fix once a second
+    const char setFixInterval[] = "PMTK220,1000";
+    mtk_send(setFixInterval, sizeof(setFixInterval) - 1);
+
+    // Pulse every second once there has been a fix, for 100ms
+    const char setTimePulse[] = "PMTK285,1,100";
+    mtk_send(setTimePulse, sizeof(setTimePulse) - 1);
+
+    gps_driver_set_message_rates(rates);
+}
+
+void gps_driver_set_message_rates(const uint8_t* rates)
+{
+    // Every field has to be given, so all sentences are set at once
+    char command[7 + (kPmtk314NumFields * 2)] = "PMTK314";
+
+    for (uint8_t field = 0; field < kPmtk314NumFields; ++field) {
+        command[7 + (field * 2)] = ',';
+        command[8 + (field * 2)] = '0';
+    }
+
+    for (uint8_t message = 0; message < kNumGpsMessages; ++message) {
+        const uint8_t rate = (rates[message] > kPmtkMaxRate) ? kPmtkMaxRate : rates[message];
+        command[8 + (kPmtk314Fields[message] * 2)] = '0' + rate;
+    }
+
+    mtk_send(command, sizeof(command));
+}
+
+#endif
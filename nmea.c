@@ -1,20 +1,48 @@
 #include "nmea.h"
 
+#include "ubxgps.h"
+
 #include <stdbool.h>
+#include <stddef.h>
+
+// Field numbers of sentences with a time in them
+// Field 0 is the sentence type, and each comma moves to the next field
+enum RmcField {
+    kRMC_Timestamp = 1, // UTC of position fix
+    kRMC_Validity, // Data status (A=ok, V=navigation receiver warning)
+    kRMC_Latitude, // Latitude of fix
+    kRMC_Latitude_NorthSouth, // N or S
+    kRMC_Longitude, // Longitude of fix
+    kRMC_Longitude_EastWest, // E or W
+    kRMC_SpeedInKnots, // Speed over ground in knots
+    kRMC_TrueCourse, // Track made good in degrees True
+    kRMC_DateStamp, // UT date
+};
+
+enum ZdaField {
+    kZDA_Timestamp = 1, // UTC time
+    kZDA_Day, // Day of the month (01 to 31)
+    kZDA_Month, // Month (01 to 12)
+    kZDA_Year, // Four digit year
+};
 
-enum GPRMCField {
-    GPRMC_SentenceType = 0,
-    GPRMC_Timestamp, // UTC of position fix
-    GPRMC_Validity, // Data status (A=ok, V=navigation receiver warning)
-    GPRMC_Latitude, // Latitude of fix
-    GPRMC_Latitude_NorthSouth, // N or S
-    GPRMC_Longitude, // Longitude of fix
-    GPRMC_Longitude_EastWest, // E or W
-    GPRMC_SpeedInKnots, // Speed over ground in knots
-    GPRMC_TrueCourse, // Track made good in degrees True
-    GPRMC_DateStamp, // UT date
-    GPRMC_Variation, // Magnetic variation degrees (Easterly var. subtracts from true course)
-    GPRMC_Variation_EastWest, // E or W
+enum GgaField {
+    kGGA_Timestamp = 1, // UTC of position fix
+    kGGA_Latitude, // Latitude of fix
+    kGGA_Latitude_NorthSouth, // N or S
+    kGGA_Longitude, // Longitude of fix
+    kGGA_Longitude_EastWest, // E or W
+    kGGA_Quality, // Fix quality (0 = no fix)
+};
+
+enum GsvField {
+    kGSV_MessageCount = 1, // Number of GSV sentences in this set
+    kGSV_MessageNumber, // Number of this sentence in the set (starting at 1)
+    kGSV_SatellitesInView, // Total number of satellites in view
+    kGSV_Snr1 = 7, // Signal to noise ratio of the first satellite listed (blank if not tracked)
+    kGSV_Snr2 = 11, // Up to four satellites are listed per sentence, with four fields each
+    kGSV_Snr3 = 15,
+    kGSV_Snr4 = 19,
 };
 
 enum NmeaReadState {
@@ -23,6 +51,7 @@ enum NmeaReadState {
     kReadType,
     kReadFields,
     kChecksumVerify,
+    kReadUbx,
 };
 
 /**
@@ -55,189 +84,746 @@ static inline uint8_t hex2int(char* hexPair)
     return output;
 }
 
+// Maximum number of characters in an NMEA sentence including the start '$' and end '\r\n'
+#define kNmeaMaxLength 82
+
+// Length of the "GPRMC" style type field: a two character talker ID, then the sentence type
+#define kTalkerLength 2
+#define kTypeLength 5
+
+// Number of digit pairs in a complete date and time (hour to year)
+#define kDateTimePairs 6
+
 /**
- * Convert a two character numeric string to an 8-bit number
+ * How a byte in a sentence field is read
+ */
+enum NmeaFieldType {
+    // Two digits shifted into a packed BCD byte of DateTime
+    kField_Digits,
+
+    // Coordinate as ddmm.mm or dddmm.mm
+    kField_Coordinate,
+
+    // N or S hemisphere of the preceding coordinate
+    kField_NorthSouth,
+
+    // E or W hemisphere of the preceding coordinate
+    kField_EastWest,
+
+    // Status character: 'A' means the position is valid
+    kField_Status,
+
+    // Fix quality digit: anything but '0' means the position is valid
+    kField_Quality,
+
+    // Fractional part of a timestamp, following its seconds digits
+    kField_Fraction,
+
+    // GSV sentence count, sentence number and satellites in view
+    kField_GsvCount,
+    kField_GsvNumber,
+    kField_SatellitesInView,
+
+    // Signal to noise ratio of one satellite in a GSV sentence
+    kField_Snr,
+
+    // Marks the end of a sentence's field list
+    kField_End,
+};
+
+/**
+ * Description of one value read from a sentence
  *
- * Using this saves 50 bytes of program space over the stdlib implementation by
- * knowing that str has contains exactly two numeric characters (zero padded if one digit).
- * The AVR stdlib version also uses a 16-bit signed integer, which we don't need.
+ * Entries for a sentence must be in field order. A field can have several entries (eg. the hour,
+ * minute and second of "hhmmss"), which are read in turn.
+ */
+typedef struct NmeaField {
+    // Field number in the sentence (field 0 is the sentence type)
+    uint8_t field;
+
+    // An NmeaFieldType
+    uint8_t type;
+
+    // For kField_Digits: index of the first of the two digits within the field
+    uint8_t digit;
+
+    // For kField_Digits: offset of the destination byte in DateTime
+    uint8_t offset;
+} NmeaField;
+
+// Build an entry for two digits of a field
+#define NMEA_DIGITS(field, digit, member) { field, kField_Digits, digit, offsetof(DateTime, member) }
+
+// Build an entry for a field that isn't part of the time
+#define NMEA_FIELD(field, type) { field, type, 0, 0 }
+
+// Terminate a field list
+#define NMEA_END { 0xFF, kField_End, 0, 0 }
+
+/**
+ * Sentence types gps_read_time() understands
+ */
+typedef struct NmeaSentence {
+    // Sentence type following the talker ID (eg. "RMC" from "GPRMC" or "GNRMC")
+    char type[3];
+
+    // Values to read from the sentence, ending with NMEA_END
+    const NmeaField* fields;
+
+    // Number of kField_Digits entries in fields (kDateTimePairs if the sentence has a date)
+    uint8_t timePairs;
+
+    // The sentence carries a position and fix status
+    bool hasPosition;
+} NmeaSentence;
+
+// Parser state, kept between calls so sentences can be consumed as their bytes arrive
+static struct {
+    // Date/time collected from the current sentence
+    DateTime time;
+
+    // Number of digit pairs read into time
+    uint8_t timePairs;
+
+    uint8_t calculatedChecksum;
+
+    // Buffer for storing the checksum pair read from the GPS
+    char buffer[2];
+    uint8_t bufIndex;
+
+    // Sentence type characters read after the talker ID
+    char type[3];
+    uint8_t typeLength;
+
+    // Matched sentence type
+    const NmeaSentence* sentence;
+
+    // Number of bytes consumed for the current sentence
+    uint8_t length;
+
+    // Sentence matching state
+    enum NmeaReadState state;
+
+    // Field number being read, and the number of bytes read into it so far
+    uint8_t field;
+    uint8_t fieldLength;
+
+    // Next entry in the matched sentence's field list to be read
+    const NmeaField* entry;
+
+    // Fractional seconds read from the timestamp, and the value of the next digit
+    uint16_t milliseconds;
+    uint8_t fractionScale;
+
+    // Value of length when the '*' before the checksum was read, and when it was received
+    uint8_t dataLength;
+    uint32_t dataEnd;
+    bool dataEndValid;
+
+#if CONFIG_GSV_STATUS
+    // Values read from the GSV sentence, which are only used once its checksum is verified
+    struct {
+        uint8_t messageCount;
+        uint8_t messageNumber;
+        uint8_t inView;
+        uint8_t bestSnr;
+
+        // Number in the current satellite's SNR field
+        uint8_t snr;
+    } gsv;
+#endif
+
+#if CONFIG_GPS_POSITION
+    // Digits of the latitude or longitude field being read, as dddmm.mm * 100
+    uint32_t coordinate;
+
+    // Number of digits read after the coordinate's decimal point (zero before it)
+    uint8_t coordinateDecimals;
+
+    GpsPosition position;
+#endif
+} _parser;
+
+static GpsSentenceTiming _timing;
+
+const GpsSentenceTiming* gps_get_timing(void)
+{
+    return &_timing;
+}
+
+#if CONFIG_GSV_STATUS
+static GpsSatellites _satellites;
+
+// Best SNR seen so far in the current set of GSV sentences
+static uint8_t _gsvBestSnr;
+
+const GpsSatellites* gps_get_satellites(void)
+{
+    return &_satellites;
+}
+
+/**
+ * Add a digit to a decimal number being read from a field, starting again for a new field
  */
-static inline uint8_t gps_atoi(char *str)
+static uint8_t gps_read_decimal(uint8_t value, char byte)
 {
-    uint8_t result = 0;
+    if (_parser.fieldLength == 0) {
+        value = 0;
+    }
 
-    result = (result * 10) + str[0] - '0';
-    result = (result * 10) + str[1] - '0';
+    return (value * 10) + (byte - '0');
+}
 
-    return result;
+/**
+ * Combine a verified GSV sentence into the current set, returning true when the set is complete
+ */
+static bool gps_end_gsv(void)
+{
+    if (_parser.gsv.messageNumber == 1) {
+        _gsvBestSnr = 0;
+    }
+
+    if (_parser.gsv.bestSnr > _gsvBestSnr) {
+        _gsvBestSnr = _parser.gsv.bestSnr;
+    }
+
+    if (_parser.gsv.messageNumber != _parser.gsv.messageCount) {
+        return false;
+    }
+
+    _satellites.inView = _parser.gsv.inView;
+    _satellites.bestSnr = _gsvBestSnr;
+
+    return true;
 }
+#endif
 
-// RMC sentence header (without null termination)
-const char GPRMC[] = {'G', 'P', 'R', 'M', 'C'};
+#if CONFIG_GPS_POSITION
+static GpsPosition _position;
 
-GpsReadStatus gps_read_time(DateTime* output)
+const GpsPosition* gps_get_position(void)
+{
+    return &_position;
+}
+
+/**
+ * Convert the coordinate field just read to 1/100ths of a degree
+ */
+static uint16_t gps_coordinate_to_centidegrees(void)
 {
+    uint32_t coordinate = _parser.coordinate;
 
-    uint8_t calculatedChecksum = 0x0;
+    // Pad out missing decimal places so the minutes are always in hundredths
+    // coordinateDecimals counts the decimal point itself, so two decimal places reads as 3
+    uint8_t decimals = _parser.coordinateDecimals;
 
-    // Buffer for storing number pairs read from the GPS
-    char buffer[2];
-    uint8_t bufIndex = 0;
+    if (decimals == 0) {
+        decimals = 1;
+    }
 
-    // Which field in the output is currently being written to
-    uint8_t outputIndex = 0;
+    for (; decimals < 3; ++decimals) {
+        coordinate *= 10;
+    }
 
-    // Current search index into GPRMC array
-    uint8_t typeStrIndex = 0;
+    const uint16_t degrees = coordinate / 10000;
+    const uint16_t minuteHundredths = coordinate % 10000;
 
-    // Initial states for  sentence matching
-    enum NmeaReadState state = kSearchStart;
-    enum GPRMCField field = GPRMC_SentenceType;
+    return (degrees * 100) + (minuteHundredths / 60);
+}
 
-    // Flag to indicate the decimal portion of time is being skipped
-    bool hitTimeDecimal = false;
+/**
+ * Collect a byte of a ddmm.mm or dddmm.mm coordinate field
+ */
+static void gps_read_coordinate(char byte)
+{
+    // Coordinates are kept until their hemisphere field has been read
+    if (_parser.fieldLength == 0) {
+        _parser.coordinate = 0;
+        _parser.coordinateDecimals = 0;
+    }
 
-    // Flag to indicate the date/time field was non-empty
-    // During start-up the GPS can return blank fields while it aquires a signal
-    bool sawTimeFields = false;
+    if (byte == '.') {
+        _parser.coordinateDecimals = 1;
+        return;
+    }
 
-    // NMEA sentences are limited to 79 characters including the start '$' and end '\r\n'
-    // Limit iterations to this for sanity
-    for (uint8_t i = 79; i != 0; --i) {
-        char byte = uart_read_byte();
+    // Only hundredths of a minute are kept (around 20 metres)
+    if (_parser.coordinateDecimals != 0) {
+        if (_parser.coordinateDecimals == 3) {
+            return;
+        }
 
-        switch (state) {
-            case kSearchStart: {
-                // Bail out if end of line hit
-                if (byte == '\n') {
-                    return kGPS_NoMatch;
-                }
+        ++_parser.coordinateDecimals;
+    }
 
-                // Look for start character
-                if (byte == '$') {
-                    state = kReadType;
-                    continue;
-                }
+    _parser.coordinate = (_parser.coordinate * 10) + (byte - '0');
+}
+
+static void gps_read_north_south(char byte)
+{
+    const int16_t latitude = gps_coordinate_to_centidegrees();
+    _parser.position.latitude = (byte == 'S') ? -latitude : latitude;
+}
+
+static void gps_read_east_west(char byte)
+{
+    const uint16_t longitude = gps_coordinate_to_centidegrees();
+    _parser.position.longitude = (byte == 'W' && longitude != 0) ? 36000 - longitude : longitude;
+}
+#endif
+
+// Fields of each sentence read for the time
+static const NmeaField kRmcFields[] = {
+    NMEA_DIGITS(kRMC_Timestamp, 0, hour),
+    NMEA_DIGITS(kRMC_Timestamp, 2, minute),
+    NMEA_DIGITS(kRMC_Timestamp, 4, second),
+    NMEA_FIELD(kRMC_Timestamp, kField_Fraction),
+#if CONFIG_GPS_POSITION
+    NMEA_FIELD(kRMC_Validity, kField_Status),
+    NMEA_FIELD(kRMC_Latitude, kField_Coordinate),
+    NMEA_FIELD(kRMC_Latitude_NorthSouth, kField_NorthSouth),
+    NMEA_FIELD(kRMC_Longitude, kField_Coordinate),
+    NMEA_FIELD(kRMC_Longitude_EastWest, kField_EastWest),
+#endif
+    NMEA_DIGITS(kRMC_DateStamp, 0, day),
+    NMEA_DIGITS(kRMC_DateStamp, 2, month),
+    NMEA_DIGITS(kRMC_DateStamp, 4, year),
+    NMEA_END,
+};
+
+static const NmeaField kZdaFields[] = {
+    NMEA_DIGITS(kZDA_Timestamp, 0, hour),
+    NMEA_DIGITS(kZDA_Timestamp, 2, minute),
+    NMEA_DIGITS(kZDA_Timestamp, 4, second),
+    NMEA_FIELD(kZDA_Timestamp, kField_Fraction),
+    NMEA_DIGITS(kZDA_Day, 0, day),
+    NMEA_DIGITS(kZDA_Month, 0, month),
+    NMEA_DIGITS(kZDA_Year, 2, year), // Last two digits of the four digit year
+    NMEA_END,
+};
+
+static const NmeaField kGgaFields[] = {
+    NMEA_DIGITS(kGGA_Timestamp, 0, hour),
+    NMEA_DIGITS(kGGA_Timestamp, 2, minute),
+    NMEA_DIGITS(kGGA_Timestamp, 4, second),
+    NMEA_FIELD(kGGA_Timestamp, kField_Fraction),
+#if CONFIG_GPS_POSITION
+    NMEA_FIELD(kGGA_Latitude, kField_Coordinate),
+    NMEA_FIELD(kGGA_Latitude_NorthSouth, kField_NorthSouth),
+    NMEA_FIELD(kGGA_Longitude, kField_Coordinate),
+    NMEA_FIELD(kGGA_Longitude_EastWest, kField_EastWest),
+    NMEA_FIELD(kGGA_Quality, kField_Quality),
+#endif
+    NMEA_END,
+};
+
+#if CONFIG_GSV_STATUS
+static const NmeaField kGsvFields[] = {
+    NMEA_FIELD(kGSV_MessageCount, kField_GsvCount),
+    NMEA_FIELD(kGSV_MessageNumber, kField_GsvNumber),
+    NMEA_FIELD(kGSV_SatellitesInView, kField_SatellitesInView),
+    NMEA_FIELD(kGSV_Snr1, kField_Snr),
+    NMEA_FIELD(kGSV_Snr2, kField_Snr),
+    NMEA_FIELD(kGSV_Snr3, kField_Snr),
+    NMEA_FIELD(kGSV_Snr4, kField_Snr),
+    NMEA_END,
+};
+#endif
+
+// Sentences that can be read, from any talker (GP, GN, GL, etc)
+// Sentences with no time digits are read for satellite information only
+static const NmeaSentence kNmeaSentences[] = {
+    { {'R', 'M', 'C'}, kRmcFields, kDateTimePairs, true },
+    { {'Z', 'D', 'A'}, kZdaFields, kDateTimePairs, false },
+    { {'G', 'G', 'A'}, kGgaFields, 3, true },
+#if CONFIG_GSV_STATUS
+    { {'G', 'S', 'V'}, kGsvFields, 0, false },
+#endif
+};
+
+#define kNumNmeaSentences (sizeof(kNmeaSentences) / sizeof(kNmeaSentences[0]))
+
+/**
+ * Find the sentence type read into _parser.type, or return NULL if it isn't supported
+ */
+static const NmeaSentence* gps_match_type(void)
+{
+    for (uint8_t i = 0; i < kNumNmeaSentences; ++i) {
+        const NmeaSentence* sentence = &kNmeaSentences[i];
 
-                // Not the character we're looking for
-                continue;
+        if (sentence->type[0] == _parser.type[0] &&
+            sentence->type[1] == _parser.type[1] &&
+            sentence->type[2] == _parser.type[2]) {
+            return sentence;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Read a byte of a data field using the matched sentence's field list
+ */
+static void gps_read_field(char byte)
+{
+    const NmeaField* entry = _parser.entry;
+
+    // Nothing is wanted from this field
+    if (entry->field != _parser.field) {
+        return;
+    }
+
+    switch (entry->type) {
+        case kField_Digits: {
+            // Skip leading digits (eg. the century) and anything that isn't a digit
+            if (_parser.fieldLength < entry->digit || byte < '0' || byte > '9') {
+                return;
             }
 
-            case kSkipSentence: {
-                // Ignore all further bytes until the sentence ends
-                if (byte != '\n') {
-                    continue;
-                }
+            // Shifting a nibble at a time gives packed BCD without any multiplication
+            uint8_t* value = ((uint8_t*) &_parser.time) + entry->offset;
+            *value = (*value << 4) | (byte & 0x0F);
 
-                return kGPS_NoMatch;
-            }
-
-            case kReadType: {
-                // Include sentence type in checksum
-                calculatedChecksum ^= byte;
-
-                // Try to match against sentence type we want
-                if (byte == GPRMC[typeStrIndex]) {
-                    if (typeStrIndex == (sizeof(GPRMC) - 1)) {
-                        // Matched last character in the flag we want
-                        state = kReadFields;
-                    } else {
-                        ++typeStrIndex;
-                    }
-                } else {
-                    // Saw a '$' but the sentence type didn't match
-                    // Ignore everything further in this message
-                    state = kSkipSentence;
-                }
+            // Move on to the next entry once both digits are in
+            if (_parser.fieldLength != entry->digit) {
+                ++_parser.timePairs;
+                ++_parser.entry;
+            }
+
+            return;
+        }
+
+        case kField_Fraction:
+            // Milliseconds are plenty: skip the '.' and any digits past them
+            if (byte >= '0' && byte <= '9' && _parser.fractionScale != 0) {
+                _parser.milliseconds += (byte & 0x0F) * _parser.fractionScale;
+                _parser.fractionScale /= 10;
+            }
+            return;
+
+#if CONFIG_GSV_STATUS
+        // Values are read straight from the bytes as they arrive, so nothing is buffered
+        case kField_GsvCount:
+            _parser.gsv.messageCount = gps_read_decimal(_parser.gsv.messageCount, byte);
+            return;
+
+        case kField_GsvNumber:
+            _parser.gsv.messageNumber = gps_read_decimal(_parser.gsv.messageNumber, byte);
+            return;
 
-                continue;
+        case kField_SatellitesInView:
+            _parser.gsv.inView = gps_read_decimal(_parser.gsv.inView, byte);
+            return;
+
+        case kField_Snr:
+            // The value only increases as digits are added, so it can be compared as it's read
+            _parser.gsv.snr = gps_read_decimal(_parser.gsv.snr, byte);
+
+            if (_parser.gsv.snr > _parser.gsv.bestSnr) {
+                _parser.gsv.bestSnr = _parser.gsv.snr;
             }
+            return;
+#endif
+
+#if CONFIG_GPS_POSITION
+        case kField_Coordinate:
+            gps_read_coordinate(byte);
+            return;
+
+        case kField_NorthSouth:
+            gps_read_north_south(byte);
+            return;
+
+        case kField_EastWest:
+            gps_read_east_west(byte);
+            return;
+
+        case kField_Status:
+            _parser.position.valid = (byte == 'A');
+            return;
+
+        case kField_Quality:
+            _parser.position.valid = (byte != '0');
+            return;
+#endif
 
-            case kReadFields: {
+        default:
+            return;
+    }
+}
+
+/**
+ * Reset the parser to search for a new sentence and pass through the status of the last one
+ */
+static GpsReadStatus gps_end_sentence(GpsReadStatus status)
+{
+    _parser.calculatedChecksum = 0x0;
+    _parser.bufIndex = 0;
+    _parser.timePairs = 0;
+    _parser.typeLength = 0;
+    _parser.sentence = 0;
+    _parser.length = 0;
+    _parser.state = kSearchStart;
+    _parser.field = 0;
+    _parser.fieldLength = 0;
+    _parser.milliseconds = 0;
+    _parser.fractionScale = 100;
+
+#if CONFIG_GSV_STATUS
+    _parser.gsv.bestSnr = 0;
+#endif
+
+#if CONFIG_GPS_POSITION
+    _parser.position.valid = false;
+#endif
+
+    return status;
+}
 
-                // Asterisk marks the end of the data and start of the checksum
-                if (byte == '*') {
-                    state = kChecksumVerify;
-                    continue;
+/**
+ * Feed one byte to the parser, returning kGPS_Incomplete until a sentence ends
+ */
+static GpsReadStatus gps_read_byte(char byte, DateTime* output)
+{
+#if CONFIG_UBX_INPUT
+    // UBX frames are binary, so they're read separately until they end
+    if (_parser.state == kReadUbx) {
+        switch (ubx_read_byte(byte)) {
+            case kUBX_Incomplete:
+                return kGPS_Incomplete;
+
+            case kUBX_Complete:
+#if CONFIG_UBX_TIMEPULSE
+                if (ubx_decode_tim_tp(ubx_get_frame(), output, &_timing.quantisationError)) {
+                    return gps_end_sentence(kGPS_PulseTime);
                 }
+#endif
+
+                return gps_end_sentence(kGPS_UbxFrame);
+
+            default:
+                return gps_end_sentence(kGPS_NoMatch);
+        }
+    }
+
+    // UBX frames only start between sentences
+    if (_parser.state == kSearchStart && (uint8_t) byte == kUbxSync1) {
+        ubx_start_frame();
+        _parser.state = kReadUbx;
+        return kGPS_Incomplete;
+    }
+#endif
+
+    // A '$' always starts a new sentence, even part way through another (eg. if bytes were
+    // dropped or parsing began mid-line), so a good sentence is never lost to misalignment
+    if (byte == '$') {
+        const bool truncated = (_parser.state != kSearchStart && _parser.state != kSkipSentence);
+
+        gps_end_sentence(kGPS_Truncated);
+        _parser.state = kReadType;
+        _parser.length = 1;
+
+        if (truncated) {
+            return kGPS_Truncated;
+        }
+
+        return kGPS_Incomplete;
+    }
+
+    switch (_parser.state) {
+        case kSearchStart: {
+            // Bail out if end of line hit
+            if (byte == '\n') {
+                return gps_end_sentence(kGPS_NoMatch);
+            }
+
+            // Not the character we're looking for
+            return kGPS_Incomplete;
+        }
 
-                // Calculate checksum across sentence contents
-                calculatedChecksum ^= byte;
+        case kSkipSentence: {
+            // Ignore all further bytes until the sentence ends
+            if (byte != '\n') {
+                return kGPS_Incomplete;
+            }
+
+            return gps_end_sentence(kGPS_NoMatch);
+        }
+
+        default:
+            break;
+    }
+
+    // The line ended before the checksum
+    if (byte == '\n') {
+        return gps_end_sentence(kGPS_Truncated);
+    }
 
-                // Fields are delimited by commas
-                if (byte == ',') {
-                    ++field;
-                    continue;
+    // NMEA sentences are limited in length: give up on anything longer for sanity
+    // This is only counted from the '$' of a sentence being read, so it's unaffected by
+    // where parsing started or how long the skipped sentences before it were.
+    if (_parser.length == kNmeaMaxLength) {
+        return gps_end_sentence(kGPS_BadFormat);
+    }
+
+    ++_parser.length;
+
+    switch (_parser.state) {
+        case kReadType: {
+            // Include sentence type in checksum
+            _parser.calculatedChecksum ^= byte;
+
+            if (byte != ',') {
+                // Keep the characters after the talker ID, ignoring anything too long to match
+                if (_parser.typeLength >= kTalkerLength && _parser.typeLength < kTypeLength) {
+                    _parser.type[_parser.typeLength - kTalkerLength] = byte;
                 }
 
-                switch (field) {
-                    case GPRMC_Timestamp: {
+                ++_parser.typeLength;
+                return kGPS_Incomplete;
+            }
 
-                        // Skip the fractional part of the timestamp field as we don't use it
-                        // This isn't guaranteed to be present in every message
-                        if (hitTimeDecimal || byte == '.') {
-                            hitTimeDecimal = true;
-                            continue;
-                        }
+            if (_parser.typeLength == kTypeLength) {
+                _parser.sentence = gps_match_type();
+            }
 
-                        // INTENTIONAL FALL THROUGH TO DATESTAMP
-                    }
+            if (_parser.sentence == 0) {
+                // Saw a '$' but the sentence type isn't one we read
+                // Ignore everything further in this message
+                _parser.state = kSkipSentence;
+                return kGPS_Incomplete;
+            }
 
-                    case GPRMC_DateStamp: {
+            _parser.state = kReadFields;
+            _parser.field = 1;
+            _parser.entry = _parser.sentence->fields;
+            return kGPS_Incomplete;
+        }
+
+        case kReadFields: {
 
-                        // Collect pairs of characters and convert them to numbers
-                        buffer[bufIndex] = byte;
-                        bufIndex++;
+            // Asterisk marks the end of the data and start of the checksum
+            if (byte == '*') {
+                _parser.state = kChecksumVerify;
+                _parser.dataLength = _parser.length;
+                return kGPS_Incomplete;
+            }
 
-                        if (bufIndex == 2) {
-                            bufIndex = 0;
-                            ((uint8_t*) output)[outputIndex] = gps_atoi(buffer);
-                            ++outputIndex;
-                        } else {
-                            continue;
-                        }
+            // Calculate checksum across sentence contents
+            _parser.calculatedChecksum ^= byte;
 
-                        sawTimeFields = true;
-                        continue;
-                    }
+            // Fields are delimited by commas
+            if (byte == ',') {
+                ++_parser.field;
+                _parser.fieldLength = 0;
 
-                    default:
-                        // Skip other fields
-                        continue;
+                // Skip entries for any fields that ended early (eg. blank before a fix)
+                while (_parser.entry->field < _parser.field) {
+                    ++_parser.entry;
                 }
+
+                return kGPS_Incomplete;
+            }
+
+            gps_read_field(byte);
+            ++_parser.fieldLength;
+            return kGPS_Incomplete;
+        }
+
+        case kChecksumVerify: {
+            uint8_t receivedChecksum = 0x0;
+
+            // Collect checksum
+            _parser.buffer[_parser.bufIndex] = byte;
+            _parser.bufIndex++;
+
+            if (_parser.bufIndex == 2) {
+                receivedChecksum = hex2int(_parser.buffer);
+            } else {
+                return kGPS_Incomplete;
+            }
+
+            *output = _parser.time;
+
+            if (receivedChecksum != _parser.calculatedChecksum) {
+                return gps_end_sentence(kGPS_InvalidChecksum);
             }
 
-            case kChecksumVerify: {
-                uint8_t receivedChecksum = 0x0;
+#if CONFIG_GPS_POSITION
+            if (_parser.sentence->hasPosition) {
+                _position = _parser.position;
+            }
+#endif
+
+#if CONFIG_GSV_STATUS
+            if (_parser.sentence->timePairs == 0) {
+                // Only the last sentence of a set is reported: the others are part way through
+                return gps_end_sentence(gps_end_gsv() ? kGPS_Satellites : kGPS_NoMatch);
+            }
+#endif
+
+            // During start-up the GPS can return blank fields while it aquires a signal
+            // Only report success when the complete date and time were present
+            if (_parser.timePairs == _parser.sentence->timePairs) {
+                _timing.milliseconds = _parser.milliseconds;
+                _timing.length = _parser.dataLength;
+                _timing.end = _parser.dataEnd;
+                _timing.endValid = _parser.dataEndValid;
 
-                // Collect checksum
-                buffer[bufIndex] = byte;
-                bufIndex++;
+                return gps_end_sentence(_parser.timePairs == kDateTimePairs ? kGPS_Success : kGPS_TimeOnly);
+            }
+
+            return gps_end_sentence(kGPS_NoSignal);
+        }
 
-                if (bufIndex == 2) {
-                    receivedChecksum = hex2int(buffer);
-                } else {
-                    continue;
+        default:
+            // Entered an unrecognised state: abort
+            return gps_end_sentence(kGPS_UnknownState);
+    }
+}
+
+GpsReadStatus gps_read_time(DateTime* output)
+{
+    const char* bytes;
+    uint8_t available;
+
+    // Bytes are scanned in place in the receive buffer, and only marked as read in one go
+    while ((available = uart_peek(&bytes)) != 0) {
+        uint8_t i = 0;
+
+        while (i != available) {
+            // Outside a sentence being read, only the start or end of a line matters, or the
+            // start of a UBX frame (0xB5 is its first sync character)
+            if (_parser.state == kSearchStart || _parser.state == kSkipSentence) {
+                while (i != available && bytes[i] != '$' && bytes[i] != '\n' && (uint8_t) bytes[i] != 0xB5) {
+                    ++i;
                 }
 
-                if (receivedChecksum == calculatedChecksum) {
-                    if (sawTimeFields) {
-                        return kGPS_Success;
-                    } else {
-                        return kGPS_NoSignal;
-                    }
-                } else {
-                    return kGPS_InvalidChecksum;
+                if (i == available) {
+                    break;
                 }
             }
 
-            default:
-                // Entered an unrecognised state: abort
-                return kGPS_UnknownState;
+            const uint8_t state = _parser.state;
+            const GpsReadStatus status = gps_read_byte(bytes[i], output);
+
+            // Keep when this sentence's data ended with it, as later sentences may already be waiting
+            if (state == kReadFields && _parser.state == kChecksumVerify) {
+                _parser.dataEndValid = uart_received_time(bytes + i, &_parser.dataEnd);
+            }
+
+            ++i;
+
+            if (status != kGPS_Incomplete) {
+                uart_consume(i);
+                return status;
+            }
         }
+
+        uart_consume(available);
     }
 
-    // Something has gone wrong
-    // The loop ended, which means the sentence was longer than allowed by NMEA
-    return kGPS_BadFormat;
-}
\ No newline at end of file
+    // Ran out of received bytes part way through a sentence
+    // Parsing continues from the same state on the next call
+    return kGPS_Incomplete;
+}
@@ -1,7 +1,16 @@
 #pragma once
 
+#include "config.h"
+
+#include <stdbool.h>
 #include <stdint.h>
 
+/**
+ * UTC date and time as read from the GPS
+ *
+ * Fields are packed BCD (eg. 59 is stored as 0x59) so digits can be displayed directly.
+ * The parser fills the fields in order from hour to year.
+ */
 typedef struct DateTime {
     uint8_t hour;
     uint8_t minute;
@@ -9,16 +18,81 @@ typedef struct DateTime {
     uint8_t day;
     uint8_t month;
     uint8_t year;
+
+    // Day of the week (0 = Sunday). This is binary and isn't set by the NMEA parser.
+    uint8_t weekday;
 } DateTime;
 
+#if CONFIG_GPS_POSITION
+/**
+ * Position of the last fix in 1/100ths of a degree
+ */
+typedef struct GpsPosition {
+    // Positive north of the equator
+    int16_t latitude;
+
+    // Degrees east, from 0 to 360
+    uint16_t longitude;
+
+    // The receiver flagged the fix as valid
+    bool valid;
+} GpsPosition;
+#endif
+
+/**
+ * When the last time read by gps_read_time() was for, and how long its sentence took to arrive
+ */
+typedef struct GpsSentenceTiming {
+    // Fractional part of the timestamp field in milliseconds (eg. 250 for "hhmmss.25")
+    uint16_t milliseconds;
+
+    // Number of bytes from the '$' to the '*' before the checksum
+    uint8_t length;
+
+    // Timebase timestamp of when the '*' was received, if endValid is set
+    uint32_t end;
+    bool endValid;
+
+    // Quantisation error of the next time pulse from the last UBX TIM-TP message in picoseconds
+    // The pulse can only be placed on the receiver's clock ticks, so this is how far it will be off.
+    int32_t quantisationError;
+} GpsSentenceTiming;
+
+#if CONFIG_GSV_STATUS
+/**
+ * Satellite summary from the last complete set of GSV sentences
+ */
+typedef struct GpsSatellites {
+    // Number of satellites the receiver reports are in view
+    uint8_t inView;
+
+    // Highest signal to noise ratio of any satellite in view in dB-Hz (0 if none are tracked)
+    uint8_t bestSnr;
+} GpsSatellites;
+#endif
+
 typedef enum GpsReadStatus {
     // GPS date and time was successfully read into output parameter
     kGPS_Success = 0,
 
-    // RMC sentence found, but it had no date/time information
+    // Time sentence found, but it had no date/time information
     kGPS_NoSignal,
 
-    // Partial sentence or unknown sentence type (this only supports RMC sentences)
+    // UTC time of the next time pulse was read into output parameter from a UBX TIM-TP message
+    // The quantisation error of that pulse is available from gps_get_timing().
+    kGPS_PulseTime,
+
+    // Time of day was read into output parameter from a sentence with no date (eg. GGA)
+    // The date fields of the output are not valid.
+    kGPS_TimeOnly,
+
+    // A UBX frame other than TIM-TP was read and can be decoded from ubx_get_frame()
+    kGPS_UbxFrame,
+
+    // The last of a set of GSV sentences was read (see gps_get_satellites())
+    kGPS_Satellites,
+
+    // Partial sentence or unknown sentence type (this only reads RMC, ZDA, GGA and GSV sentences)
     kGPS_NoMatch,
 
     // Time was read into output parameter, but the calculated checksum failed to match
@@ -27,12 +101,25 @@ typedef enum GpsReadStatus {
     // The sentence had too many characters or fields and could not be parsed
     kGPS_BadFormat,
 
+    // The sentence was cut short by a new '$' or the end of the line before its checksum
+    // Parsing has already restarted on the new sentence if there was one.
+    kGPS_Truncated,
+
     // The parser state-machine went into an undefined state
     kGPS_UnknownState,
+
+    // All received bytes were consumed part way through a sentence
+    kGPS_Incomplete,
 } GpsReadStatus;
 
 /**
- * Attempt to match GPRMC sentence in the output of uart_read_byte()
+ * Attempt to read the time from an RMC, ZDA or GGA sentence in the data from uart_peek()
+ *
+ * Sentences are matched from any talker (eg. GPRMC, GNRMC and GLRMC are all read as RMC).
+ *
+ * This never blocks: it consumes bytes only while uart_peek() returns some and
+ * returns kGPS_Incomplete when it runs out part way through a sentence. Parser state is kept
+ * between calls, so the next call picks up where the last one left off.
  *
  * The output parameter may be altered regardless of success/failure. In the case a non-success
  * status is returned, the struct should be considered in an invalid state
@@ -40,6 +127,41 @@ typedef enum GpsReadStatus {
 GpsReadStatus gps_read_time(DateTime* output);
 
 /**
- * Read a byte from the uart device
+ * Return the timing of the last sentence gps_read_time() returned kGPS_Success or kGPS_TimeOnly for
+ */
+const GpsSentenceTiming* gps_get_timing(void);
+
+#if CONFIG_GSV_STATUS
+/**
+ * Return the satellite summary from the last set of GSV sentences read by gps_read_time()
+ */
+const GpsSatellites* gps_get_satellites(void);
+#endif
+
+#if CONFIG_GPS_POSITION
+/**
+ * Return the position from the last valid RMC or GGA sentence read by gps_read_time()
+ */
+const GpsPosition* gps_get_position(void);
+#endif
+
+/**
+ * Point bytes at received data that can be read in place, returning how many bytes there are
+ *
+ * This returns zero when nothing has been received. Data that wraps around the end of the
+ * receive buffer is returned by the next call, after the first part is consumed.
+ */
+extern uint8_t uart_peek(const char** bytes);
+
+/**
+ * Mark a number of bytes returned by uart_peek() as read
+ */
+extern void uart_consume(uint8_t count);
+
+/**
+ * Look up the timebase timestamp of when a '*' returned by uart_peek() was received
+ *
+ * Byte must point into the data from uart_peek(), before it's consumed. Returns false if no
+ * time was kept for it (eg. too many others arrived before it was read).
  */
-extern char uart_read_byte();
\ No newline at end of file
+extern bool uart_received_time(const char* byte, uint32_t* time);
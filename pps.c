@@ -0,0 +1,118 @@
+#include "pps.h"
+
+PpsStats pps_stats = {
+    .averagePeriod = kPpsNominalPeriod,
+    .latencyMin = 0xFFFF,
+
+    // Extremes start out of range so the first measured jitter sets both
+    .jitterMin = INT16_MAX,
+    .jitterMax = INT16_MIN,
+};
+
+// True while seconds are being counted from the average period in place of pulses
+static bool _holdover = false;
+
+// Seconds pps_holdover_due() has counted since the last pulse
+static uint16_t _holdoverSeconds = 0;
+
+static void pps_record_latency(uint16_t latency)
+{
+    if (latency < pps_stats.latencyMin) {
+        pps_stats.latencyMin = latency;
+    }
+
+    if (latency > pps_stats.latencyMax) {
+        pps_stats.latencyMax = latency;
+    }
+}
+
+bool pps_record_edge(uint32_t timestamp, uint16_t latency)
+{
+    pps_record_latency(latency);
+
+    // Nothing to measure against for the first pulse
+    if (pps_stats.count == 0) {
+        pps_stats.lastEdge = timestamp;
+        pps_stats.count = 1;
+        return true;
+    }
+
+    const uint32_t period = timestamp - pps_stats.lastEdge;
+
+    // Too early to be the next pulse: ignore it and keep waiting for the real one
+    if (period < pps_stats.averagePeriod - kPpsWindow) {
+        ++pps_stats.glitches;
+        return false;
+    }
+
+    // Seconds since the last pulse that have already been shown by holdover
+    const uint16_t counted = _holdoverSeconds;
+    _holdoverSeconds = 0;
+
+    pps_stats.lastEdge = timestamp;
+    ++pps_stats.count;
+
+    if (period > pps_stats.averagePeriod + kPpsWindow) {
+        // One or more pulses didn't arrive. Count how many seconds passed, but don't use
+        // this interval for the period statistics as it may not be a whole number of them.
+        const uint16_t seconds = (period + (pps_stats.averagePeriod / 2)) / pps_stats.averagePeriod;
+
+        // Pulses are stopped on purpose during holdover, so those aren't missed
+        if (!_holdover) {
+            pps_stats.missed += seconds - 1;
+        }
+
+        return seconds > counted;
+    }
+
+    pps_stats.period = period;
+
+    // Jitter is measured against the average so oscillator error isn't counted
+    const int16_t jitter = (int32_t) (period - pps_stats.averagePeriod);
+    pps_stats.jitter = jitter;
+
+    if (jitter < pps_stats.jitterMin) {
+        pps_stats.jitterMin = jitter;
+    }
+
+    if (jitter > pps_stats.jitterMax) {
+        pps_stats.jitterMax = jitter;
+    }
+
+    // Move the average 1/16th of the way towards this period
+    pps_stats.averagePeriod += jitter / 16;
+
+    return counted == 0;
+}
+
+bool pps_overdue(uint32_t now)
+{
+    return pps_stats.count == 0 || (now - pps_stats.lastEdge) > pps_stats.averagePeriod + kPpsWindow;
+}
+
+void pps_set_holdover(bool enabled)
+{
+    if (!enabled) {
+        _holdoverSeconds = 0;
+    }
+
+    _holdover = enabled;
+}
+
+bool pps_holdover_due(uint32_t now)
+{
+    // There's nothing to count from until a pulse has been seen
+    if (!_holdover || pps_stats.count == 0) {
+        return false;
+    }
+
+    // Whole seconds since the last pulse, as measured by the average period
+    const uint32_t elapsed = (now - pps_stats.lastEdge) / pps_stats.averagePeriod;
+
+    if (elapsed <= _holdoverSeconds || _holdoverSeconds >= kPpsHoldoverLimit) {
+        return false;
+    }
+
+    ++_holdoverSeconds;
+    return true;
+}
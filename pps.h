@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Nominal time between pulses in microseconds
+#define kPpsNominalPeriod 1000000
+
+// Longest holdover counted from the last pulse in seconds (kept well inside the timebase wrap)
+#define kPpsHoldoverLimit 3600
+
+// Pulses further than this from the expected time are treated as glitches (microseconds)
+// This allows for the +/-1% tolerance of the HSI oscillator the timebase runs from
+#define kPpsWindow 20000
+
+/**
+ * Running statistics for the GPS time pulse, measured against the timebase
+ */
+typedef struct PpsStats {
+    // Timebase timestamp of the most recent accepted pulse
+    uint32_t lastEdge;
+
+    // Time between the last two consecutive pulses
+    uint32_t period;
+
+    // Average period, which is the length of one second as measured by the timebase
+    uint32_t averagePeriod;
+
+    // Difference between the last period and the average, with the extremes seen
+    int16_t jitter;
+    int16_t jitterMin;
+    int16_t jitterMax;
+
+    // Time from the edge to the interrupt handler starting (only measured with input capture)
+    uint16_t latencyMin;
+    uint16_t latencyMax;
+
+    // Number of accepted pulses
+    uint16_t count;
+
+    // Number of pulses expected but not seen
+    uint16_t missed;
+
+    // Number of edges rejected for arriving too far from the expected time
+    uint16_t glitches;
+
+    // Quantisation error the receiver reported for the latest pulse in picoseconds (UBX TIM-TP)
+    int32_t quantisationError;
+} PpsStats;
+
+extern PpsStats pps_stats;
+
+/**
+ * Record a time pulse edge
+ *
+ * Timestamp is from the timebase and latency is the delay before this was called.
+ * Returns false if the edge was rejected as a glitch, or marks a second already counted by
+ * pps_holdover_due().
+ */
+bool pps_record_edge(uint32_t timestamp, uint16_t latency);
+
+/**
+ * Return true if no pulse has been accepted within a second (plus the glitch window) of now
+ *
+ * Now is a timebase timestamp. This must be called with interrupts disabled.
+ */
+bool pps_overdue(uint32_t now);
+
+/**
+ * Start or stop counting seconds from the average period while the pulse is expected to stop
+ *
+ * Seconds are counted on from the last pulse. Starting holdover while it's already running
+ * carries on with the current count.
+ */
+void pps_set_holdover(bool enabled);
+
+/**
+ * Return true when another second has passed since the last pulse while in holdover
+ *
+ * Now is a timebase timestamp. This must be called with interrupts disabled. At most one second
+ * is returned per call, and counting stops kPpsHoldoverLimit seconds after the last pulse.
+ */
+bool pps_holdover_due(uint32_t now);
@@ -0,0 +1,42 @@
+#include "scheduler.h"
+
+#include "timebase.h"
+
+volatile bool _schedReady[kNumTasks];
+TaskStats sched_stats[kNumTasks];
+
+void sched_run(void)
+{
+    while (true) {
+        uint8_t task = 0;
+
+        // Interrupts are blocked between checking the ready flags and going to sleep, so a
+        // flag set in that window can't be missed. WFI re-enables interrupts as it halts.
+        disableInterrupts();
+
+        while (task < kNumTasks && !_schedReady[task]) {
+            ++task;
+        }
+
+        if (task == kNumTasks) {
+            wfi();
+            continue;
+        }
+
+        _schedReady[task] = false;
+        enableInterrupts();
+
+        // Run the task and record how long it took
+        const uint32_t start = timebase_now();
+        sched_tasks[task]();
+        const uint16_t elapsed = timebase_now() - start;
+
+        TaskStats* stats = sched_stats + task;
+        ++stats->runCount;
+        stats->totalTimeUs += elapsed;
+
+        if (elapsed > stats->maxTimeUs) {
+            stats->maxTimeUs = elapsed;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Tasks run by the main loop, in priority order (highest first)
+ *
+ * When several tasks are ready, the one with the lowest ID always runs first.
+ */
+typedef enum TaskId {
+    kTask_GpsParse = 0, // Consume bytes received from the GPS
+    kTask_Display,      // Compose the frame to show at the next time pulse
+    kTask_Buttons,      // Sample the timezone and DST buttons
+    kTask_Brightness,   // Average LDR readings and set display intensity
+    kTask_GpsSupervisor,// Check the GPS is still talking and pulsing
+    kTask_SelfTest,     // Step the start-up segment test
+#if CONFIG_GPS_POWER_SAVE
+    kTask_Holdover,     // Count seconds while the GPS is asleep
+#endif
+
+    kNumTasks
+} TaskId;
+
+/**
+ * Run-time counters for a task
+ */
+typedef struct TaskStats {
+    // Number of times the task has run
+    uint16_t runCount;
+
+    // Total and longest time spent running the task in microseconds
+    uint32_t totalTimeUs;
+    uint16_t maxTimeUs;
+} TaskStats;
+
+typedef void (*TaskFunc)(void);
+
+/**
+ * Functions for each task, indexed by TaskId
+ *
+ * This must be defined by the application.
+ */
+extern const TaskFunc sched_tasks[kNumTasks];
+
+extern TaskStats sched_stats[kNumTasks];
+
+// One flag per task so setting one from an interrupt is a single byte write
+extern volatile bool _schedReady[kNumTasks];
+
+/**
+ * Mark a task to be run by the main loop
+ * This is safe to call from interrupt handlers
+ */
+inline static void sched_set_ready(TaskId task)
+{
+    _schedReady[task] = true;
+}
+
+/**
+ * Run ready tasks to completion forever, sleeping while there is nothing to do
+ */
+void sched_run(void);
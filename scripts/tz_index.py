@@ -0,0 +1,215 @@
+#!/usr/bin/env python3
+
+"""
+Generate the flash-resident timezone lookup table (tzindex_data.h) from a region file
+
+The region is rasterised to a coarse grid with one 4-bit zone ID per cell. Rects that the grid
+can't represent exactly are kept as exception rectangles, which the firmware checks in order
+before falling back to the grid. Areas outside every rect are treated as "don't care", so
+coastal cells take the zone of the land they touch.
+
+Usage: tz_index.py scripts/tz_region_anz.txt > tzindex_data.h
+"""
+
+import math
+import sys
+
+if len(sys.argv) != 2:
+    print("Usage: %s <region file>" % sys.argv[0], file=sys.stderr)
+    sys.exit(1)
+
+region_path = sys.argv[1]
+
+grid_size = None
+zones = {}
+rects = []
+
+for line in open(region_path):
+    line = line.split('#')[0].strip()
+    if not line:
+        continue
+
+    parts = line.split()
+
+    if parts[0] == 'grid':
+        grid_size = float(parts[1])
+
+    elif parts[0] == 'zone':
+        zone_id = int(parts[1])
+        if not 1 <= zone_id <= 15:
+            raise ValueError("Zone IDs must be 1-15 to fit in a nibble: %d" % zone_id)
+
+        mode = parts[3]
+        if mode == 'off':
+            mode = 'kDstMode_Off'
+        elif mode == 'on':
+            mode = 'kDstMode_On'
+        elif mode.startswith('rule'):
+            mode = 'kDstMode_Rule + %d' % int(mode[4:])
+        else:
+            raise ValueError("Unknown daylight saving mode: %s" % mode)
+
+        zones[zone_id] = (int(parts[2]), mode)
+
+    elif parts[0] == 'rect':
+        zone_id = int(parts[1])
+        if zone_id not in zones:
+            raise ValueError("Rect uses undefined zone %d" % zone_id)
+
+        rects.append((zone_id,) + tuple(float(x) for x in parts[2:6]))
+
+    else:
+        raise ValueError("Unknown line: %s" % line)
+
+if grid_size is None:
+    raise ValueError("No grid size given")
+
+# Grid covers the bounds of all rects, snapped outwards to whole cells
+lat_min = math.floor(min(r[1] for r in rects) / grid_size) * grid_size
+lat_max = math.ceil(max(r[2] for r in rects) / grid_size) * grid_size
+lon_min = math.floor(min(r[3] for r in rects) / grid_size) * grid_size
+lon_max = math.ceil(max(r[4] for r in rects) / grid_size) * grid_size
+
+rows = int(round((lat_max - lat_min) / grid_size))
+cols = int(round((lon_max - lon_min) / grid_size))
+
+
+def zone_at(lat, lon):
+    """Zone of the highest priority rect covering a point (0 if none)"""
+    for zone_id, r_lat_min, r_lat_max, r_lon_min, r_lon_max in reversed(rects):
+        if r_lat_min <= lat < r_lat_max and r_lon_min <= lon < r_lon_max:
+            return zone_id
+    return 0
+
+
+def overlaps(a, b):
+    return a[1] < b[2] and b[1] < a[2] and a[3] < b[4] and b[3] < a[4]
+
+
+# Sample points in each cell to find the zone it should have. Areas outside every rect
+# (zone 0) don't count, so coastal cells take the zone of the land they touch.
+samples = 16
+grid = []
+
+for row in range(rows):
+    for col in range(cols):
+        counts = {}
+        for i in range(samples):
+            for j in range(samples):
+                lat = lat_min + (row + (i + 0.5) / samples) * grid_size
+                lon = lon_min + (col + (j + 0.5) / samples) * grid_size
+                zone_id = zone_at(lat, lon)
+                if zone_id != 0:
+                    counts[zone_id] = counts.get(zone_id, 0) + 1
+
+        grid.append(max(counts, key=lambda z: counts[z]) if counts else 0)
+
+
+def grid_at(lat, lon):
+    row = int((lat - lat_min) // grid_size)
+    col = int((lon - lon_min) // grid_size)
+    return grid[row * cols + col]
+
+
+def sample_points(rect, step):
+    _, r_lat_min, r_lat_max, r_lon_min, r_lon_max = rect
+    lat = r_lat_min + step / 2
+    while lat < r_lat_max:
+        lon = r_lon_min + step / 2
+        while lon < r_lon_max:
+            yield lat, lon
+            lon += step
+        lat += step
+    # Always include the centre so small rects are sampled
+    yield (r_lat_min + r_lat_max) / 2, (r_lon_min + r_lon_max) / 2
+
+
+# A rect becomes an exception if the grid gives the wrong answer anywhere it has priority
+step = grid_size / samples
+listed = set()
+
+for index, rect in enumerate(rects):
+    for lat, lon in sample_points(rect, step):
+        if zone_at(lat, lon) == rect[0] and grid_at(lat, lon) != rect[0]:
+            listed.add(index)
+            break
+
+# Exceptions are checked highest priority first, so any higher priority rect overlapping a
+# listed one must be listed too or the lower one would win where they overlap
+changed = True
+while changed:
+    changed = False
+    for index in list(listed):
+        for other in range(index + 1, len(rects)):
+            if other not in listed and overlaps(rects[index], rects[other]):
+                listed.add(other)
+                changed = True
+
+exceptions = [rects[i] for i in sorted(listed, reverse=True)]
+
+
+def lookup(lat, lon):
+    for zone_id, e_lat_min, e_lat_max, e_lon_min, e_lon_max in exceptions:
+        if e_lat_min <= lat < e_lat_max and e_lon_min <= lon < e_lon_max:
+            return zone_id
+    return grid_at(lat, lon)
+
+
+# Check the result gives the right zone everywhere inside the region's rects
+for rect in rects:
+    for lat, lon in sample_points(rect, step / 2):
+        expected = zone_at(lat, lon)
+        if lookup(lat, lon) != expected:
+            raise AssertionError("Lookup gives the wrong zone at %f, %f" % (lat, lon))
+
+
+def centidegrees(value):
+    return int(round(value * 100))
+
+
+out = sys.stdout
+
+print("#pragma once", file=out)
+print("", file=out)
+print("// Generated by scripts/tz_index.py from %s" % region_path, file=out)
+print("// Do not edit by hand: change the region file and regenerate this instead", file=out)
+print("", file=out)
+print("// Grid origin (south west corner) in 1/100ths of a degree, with longitude from 0 to 360 east", file=out)
+print("#define kTzGridLatMin %d" % centidegrees(lat_min), file=out)
+print("#define kTzGridLonMin %d" % (centidegrees(lon_min) % 36000), file=out)
+print("#define kTzGridCellSize %d" % centidegrees(grid_size), file=out)
+print("#define kTzGridRows %d" % rows, file=out)
+print("#define kTzGridCols %d" % cols, file=out)
+print("#define kTzNumExceptions %d" % len(exceptions), file=out)
+print("", file=out)
+
+print("// Standard offset and daylight saving mode of each zone ID (zone 0 is unknown)", file=out)
+print("static const TzZone kTzZones[%d] = {" % (max(zones) + 1), file=out)
+print("    {0, kDstMode_Off},", file=out)
+for zone_id in range(1, max(zones) + 1):
+    offset, mode = zones.get(zone_id, (0, 'kDstMode_Off'))
+    print("    {%d, %s}," % (offset, mode), file=out)
+print("};", file=out)
+print("", file=out)
+
+print("// Zone ID of each cell, two cells per byte (low nibble first), from the south west corner", file=out)
+print("static const uint8_t kTzGrid[%d] = {" % ((len(grid) + 1) // 2), file=out)
+packed = []
+for i in range(0, len(grid), 2):
+    low = grid[i]
+    high = grid[i + 1] if i + 1 < len(grid) else 0
+    packed.append("0x%02X" % (low | (high << 4)))
+for i in range(0, len(packed), 12):
+    print("    " + ", ".join(packed[i:i + 12]) + ",", file=out)
+print("};", file=out)
+print("", file=out)
+
+print("// Areas that don't line up with the grid, checked in order before it", file=out)
+print("// Bounds are in 1/100ths of a degree north and east of the grid origin", file=out)
+print("static const TzException kTzExceptions[kTzNumExceptions] = {", file=out)
+for zone_id, e_lat_min, e_lat_max, e_lon_min, e_lon_max in exceptions:
+    print("    {%d, %d, %d, %d, %d}," % (
+        centidegrees(e_lat_min - lat_min), centidegrees(e_lat_max - lat_min),
+        centidegrees(e_lon_min - lon_min), centidegrees(e_lon_max - lon_min),
+        zone_id), file=out)
+print("};", file=out)
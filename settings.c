@@ -0,0 +1,128 @@
+#include "settings.h"
+
+// This includes the typedefs normally found in stdint.h
+#include <stm8s.h>
+
+// Size of the data EEPROM on the STM8S003
+#define kEepromSize 128
+
+/**
+ * One saved copy of the settings, sized to match the 4-byte EEPROM word
+ */
+typedef struct SettingsRecord {
+    // Incremented for each save to find the newest record
+    uint8_t sequence;
+
+    Settings settings;
+
+    // CRC-8 of the sequence and settings
+    uint8_t crc;
+} SettingsRecord;
+
+#define kNumSlots (kEepromSize / sizeof(SettingsRecord))
+
+#define _eepromSlots ((const SettingsRecord*) FLASH_DATA_START_PHYSICAL_ADDRESS)
+
+// Slot holding the newest valid record, or kNumSlots if there isn't one
+static uint8_t _currentSlot = kNumSlots;
+
+// Initial CRC value, changed whenever the layout of Settings changes so older records are ignored
+// This is non-zero so that erased (all zero) EEPROM doesn't read as valid.
+// 0xFF: timezone and DST mode, 0xFE: the GPS baud rate added in the DST mode byte
+#define kSettingsLayoutCrc 0xFE
+
+/**
+ * CRC-8 (polynomial 0x07) of a record, excluding its CRC byte
+ */
+static uint8_t settings_crc(const SettingsRecord* record)
+{
+    const uint8_t* data = (const uint8_t*) record;
+    uint8_t crc = kSettingsLayoutCrc;
+
+    for (uint8_t i = 0; i < sizeof(SettingsRecord) - 1; ++i) {
+        crc ^= data[i];
+
+        for (uint8_t bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+bool settings_load(Settings* output)
+{
+    uint8_t newestSequence = 0;
+
+    _currentSlot = kNumSlots;
+
+    for (uint8_t slot = 0; slot < kNumSlots; ++slot) {
+        const SettingsRecord record = _eepromSlots[slot];
+
+        if (record.crc != settings_crc(&record)) {
+            continue;
+        }
+
+        // Sequence numbers wrap, so compare the signed distance between them
+        if (_currentSlot == kNumSlots || (int8_t) (record.sequence - newestSequence) > 0) {
+            _currentSlot = slot;
+            newestSequence = record.sequence;
+        }
+    }
+
+    if (_currentSlot == kNumSlots) {
+        return false;
+    }
+
+    *output = _eepromSlots[_currentSlot].settings;
+    return true;
+}
+
+void settings_save(const Settings* settings)
+{
+    SettingsRecord record;
+    uint8_t slot = 0;
+
+    record.sequence = 0;
+    record.settings = *settings;
+
+    if (_currentSlot != kNumSlots) {
+        const SettingsRecord current = _eepromSlots[_currentSlot];
+
+        if (current.settings.zone == settings->zone && current.settings.dstModeAndBaud == settings->dstModeAndBaud) {
+            return;
+        }
+
+        record.sequence = current.sequence + 1;
+        slot = _currentSlot + 1;
+
+        if (slot == kNumSlots) {
+            slot = 0;
+        }
+    }
+
+    record.crc = settings_crc(&record);
+
+    // Unlock data EEPROM for writing
+    FLASH->DUKR = FLASH_RASS_KEY2;
+    FLASH->DUKR = FLASH_RASS_KEY1;
+    while (!(FLASH->IAPSR & FLASH_IAPSR_DUL));
+
+    // Program the whole record as a single word
+    FLASH->CR2 |= FLASH_CR2_WPRG;
+    FLASH->NCR2 &= ~FLASH_NCR2_NWPRG;
+
+    const uint8_t* data = (const uint8_t*) &record;
+    volatile uint8_t* dest = (volatile uint8_t*) &_eepromSlots[slot];
+
+    for (uint8_t i = 0; i < sizeof(SettingsRecord); ++i) {
+        dest[i] = data[i];
+    }
+
+    while (!(FLASH->IAPSR & (FLASH_IAPSR_EOP | FLASH_IAPSR_WR_PG_DIS)));
+
+    // Lock data EEPROM again
+    FLASH->IAPSR &= ~FLASH_IAPSR_DUL;
+
+    _currentSlot = slot;
+}
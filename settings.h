@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * User settings persisted to data EEPROM
+ *
+ * This must stay two bytes so a record (with its sequence number and CRC) is one 4-byte word
+ * and can be programmed in a single operation.
+ */
+typedef struct Settings {
+    // Index into the timezone offset table
+    uint8_t zone;
+
+    // Daylight saving mode (DstMode) in the low bits, with the GPS baud rate above it
+    // These share a byte to keep records one EEPROM word: use the functions below to access them.
+    uint8_t dstModeAndBaud;
+} Settings;
+
+#define kSettingsDstModeMask 0x0F
+#define kSettingsBaudShift 4
+
+/**
+ * Return the saved daylight saving mode (DstMode)
+ */
+inline static uint8_t settings_get_dst_mode(const Settings* settings)
+{
+    return settings->dstModeAndBaud & kSettingsDstModeMask;
+}
+
+/**
+ * Return the saved GPS baud rate, as an index into the list the GPS is probed with
+ */
+inline static uint8_t settings_get_gps_baud(const Settings* settings)
+{
+    return settings->dstModeAndBaud >> kSettingsBaudShift;
+}
+
+/**
+ * Pack a daylight saving mode and GPS baud rate index for Settings.dstModeAndBaud
+ */
+#define SETTINGS_DST_MODE_AND_BAUD(dstMode, gpsBaud) ((dstMode) | ((gpsBaud) << kSettingsBaudShift))
+
+/**
+ * Read the most recently saved settings
+ *
+ * Returns false if no valid record was found, leaving the output unchanged.
+ */
+bool settings_load(Settings* output);
+
+/**
+ * Write settings to the next EEPROM slot, spreading wear across the whole EEPROM
+ *
+ * Nothing is written if the settings match the last saved record. The CPU may stall for a few
+ * milliseconds while the word is programmed.
+ */
+void settings_save(const Settings* settings);
@@ -0,0 +1,196 @@
+#include "solar.h"
+
+// Angles here are "binary degrees": a full turn is 65536, so they wrap naturally in a uint16_t
+#define kBinaryDegreesPerTurn 65536UL
+
+// Sine and cosine results are fixed-point with 14 fractional bits (16384 = 1.0)
+#define kFixedOne 16384
+
+// Intensity at full daylight, full darkness, and at the moment of sunrise/sunset
+#define kBrightnessDay 15
+#define kBrightnessNight 0
+#define kBrightnessTwilight 7
+
+// Minutes either side of sunrise and sunset to fade over
+#define kTwilightMinutes 30
+
+// First quarter of a sine wave in 64 steps
+static const int16_t kSineTable[65] = {
+    0, 402, 804, 1205, 1606, 2006, 2404, 2801,
+    3196, 3590, 3981, 4370, 4756, 5139, 5520, 5897,
+    6270, 6639, 7005, 7366, 7723, 8076, 8423, 8765,
+    9102, 9434, 9760, 10080, 10394, 10702, 11003, 11297,
+    11585, 11866, 12140, 12406, 12665, 12916, 13160, 13395,
+    13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978,
+    15137, 15286, 15426, 15557, 15679, 15791, 15893, 15986,
+    16069, 16143, 16207, 16261, 16305, 16340, 16364, 16379,
+    16384,
+};
+
+/**
+ * Sine of a binary degree angle, interpolated between table entries
+ */
+static int16_t solar_sin(uint16_t angle)
+{
+    // Each quadrant is 16384 binary degrees, split into 64 steps of 256
+    uint16_t offset = angle & 0x3FFF;
+    const uint8_t quadrant = angle >> 14;
+
+    // Second and fourth quadrants run backwards through the table
+    if (quadrant & 1) {
+        offset = 0x4000 - offset;
+    }
+
+    const uint8_t index = offset >> 8;
+    const uint8_t fraction = offset & 0xFF;
+
+    int16_t value = kSineTable[index];
+
+    if (index != 64) {
+        value += ((int32_t) (kSineTable[index + 1] - value) * fraction) >> 8;
+    }
+
+    // Bottom half of the wave is negative
+    return (quadrant & 2) ? -value : value;
+}
+
+static int16_t solar_cos(uint16_t angle)
+{
+    return solar_sin(angle + 0x4000);
+}
+
+/**
+ * Inverse cosine, returning a binary degree angle from 0 to half a turn
+ */
+static uint16_t solar_acos(int16_t value)
+{
+    uint16_t low = 0;
+    uint16_t high = 0x8000;
+
+    // Cosine falls across the range, so search for where it crosses the value
+    while (high - low > 1) {
+        const uint16_t middle = (low + high) / 2;
+
+        if (solar_cos(middle) > value) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * Convert 1/100ths of a degree to binary degrees
+ */
+static uint16_t solar_angle(int32_t centidegrees)
+{
+    return (centidegrees * (int32_t) kBinaryDegreesPerTurn) / 36000;
+}
+
+/**
+ * Wrap a number of minutes into a single day
+ */
+static uint16_t solar_wrap_minutes(int16_t minutes)
+{
+    while (minutes < 0) {
+        minutes += kMinutesPerDay;
+    }
+
+    while (minutes >= kMinutesPerDay) {
+        minutes -= kMinutesPerDay;
+    }
+
+    return minutes;
+}
+
+void solar_calculate(int16_t latitude, uint16_t longitude, uint16_t dayOfYear, SolarTimes* output)
+{
+    // Declination of the sun: -23.44 degrees * cos(day angle from the December solstice)
+    const uint16_t solsticeAngle = ((dayOfYear + 10) * kBinaryDegreesPerTurn) / 365;
+    const int16_t declination = solar_angle(((int32_t) -2344 * solar_cos(solsticeAngle)) / kFixedOne);
+
+    // Equation of time in minutes: 9.87 sin(2B) - 7.53 cos(B) - 1.5 sin(B)
+    const uint16_t b = (((int32_t) dayOfYear - 81) * (int32_t) kBinaryDegreesPerTurn) / 365;
+    const int16_t equationOfTime = (
+        ((int32_t) 987 * solar_sin(b * 2)) -
+        ((int32_t) 753 * solar_cos(b)) -
+        ((int32_t) 150 * solar_sin(b))
+    ) / ((int32_t) 100 * kFixedOne);
+
+    // Hour angle of sunrise: cos(w) = (sin(-0.833) - sin(lat) sin(dec)) / (cos(lat) cos(dec))
+    // The -0.833 degrees accounts for refraction and the size of the sun's disc
+    const uint16_t lat = solar_angle(latitude);
+    const int32_t numerator = -238 - (((int32_t) solar_sin(lat) * solar_sin(declination)) / kFixedOne);
+    const int32_t denominator = ((int32_t) solar_cos(lat) * solar_cos(declination)) / kFixedOne;
+
+    output->alwaysDay = false;
+    output->alwaysNight = false;
+
+    if (denominator == 0 || numerator >= denominator) {
+        output->alwaysNight = true;
+        return;
+    }
+
+    if (numerator <= -denominator) {
+        output->alwaysDay = true;
+        return;
+    }
+
+    const int16_t cosHourAngle = (numerator * kFixedOne) / denominator;
+
+    // A whole turn is 1440 minutes, so convert with 1440 / 65536 = 45 / 2048
+    const int16_t halfDay = ((uint32_t) solar_acos(cosHourAngle) * 45) / 2048;
+
+    // Solar noon moves 4 minutes earlier per degree east
+    int16_t east = longitude / 25;
+    if (longitude > 18000) {
+        east -= 36000 / 25;
+    }
+
+    const int16_t noon = 720 - east - equationOfTime;
+
+    output->sunrise = solar_wrap_minutes(noon - halfDay);
+    output->sunset = solar_wrap_minutes(noon + halfDay);
+}
+
+uint8_t solar_brightness(const SolarTimes* times, uint16_t minuteOfDay)
+{
+    if (times->alwaysDay) {
+        return kBrightnessDay;
+    }
+
+    if (times->alwaysNight) {
+        return kBrightnessNight;
+    }
+
+    const uint16_t dayLength = solar_wrap_minutes(times->sunset - times->sunrise);
+    const uint16_t sinceSunrise = solar_wrap_minutes(minuteOfDay - times->sunrise);
+
+    // Work out how far into the day or night we are from the nearest sunrise or sunset
+    const bool daytime = sinceSunrise < dayLength;
+    uint16_t fromEdge;
+
+    if (daytime) {
+        fromEdge = dayLength - sinceSunrise;
+        if (sinceSunrise < fromEdge) {
+            fromEdge = sinceSunrise;
+        }
+    } else {
+        fromEdge = kMinutesPerDay - sinceSunrise;
+        if (sinceSunrise - dayLength < fromEdge) {
+            fromEdge = sinceSunrise - dayLength;
+        }
+    }
+
+    if (fromEdge > kTwilightMinutes) {
+        fromEdge = kTwilightMinutes;
+    }
+
+    if (daytime) {
+        return kBrightnessTwilight + ((kBrightnessDay - kBrightnessTwilight) * fromEdge) / kTwilightMinutes;
+    }
+
+    return kBrightnessTwilight - ((kBrightnessTwilight - kBrightnessNight) * fromEdge) / kTwilightMinutes;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Minutes in a day
+#define kMinutesPerDay 1440
+
+/**
+ * Sunrise and sunset for one day
+ */
+typedef struct SolarTimes {
+    // Minutes after midnight UTC (sunset can be earlier than sunrise depending on longitude)
+    uint16_t sunrise;
+    uint16_t sunset;
+
+    // Set when the sun doesn't rise or set on this day
+    bool alwaysDay;
+    bool alwaysNight;
+} SolarTimes;
+
+/**
+ * Calculate sunrise and sunset times using fixed-point arithmetic
+ *
+ * Latitude is in 1/100ths of a degree north, and longitude in 1/100ths of a degree east from 0
+ * to 360. The day of the year starts at 1 for January 1st. This is accurate to a few minutes,
+ * which is plenty for setting display brightness.
+ */
+void solar_calculate(int16_t latitude, uint16_t longitude, uint16_t dayOfYear, SolarTimes* output);
+
+/**
+ * Return a display intensity (0 to 15) for the time of day, fading across twilight
+ */
+uint8_t solar_brightness(const SolarTimes* times, uint16_t minuteOfDay);
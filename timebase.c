@@ -0,0 +1,127 @@
+#include "timebase.h"
+
+#include "scheduler.h"
+
+// Timestamp of the start of the current tick: kTimebaseTickUs is added on each overflow of TIM2
+// This is kept in microseconds rather than ticks so it wraps at the full 32 bits.
+static volatile uint32_t _tickStart = 0;
+
+// True until the start-up self-test has finished, readying it on each tick
+static volatile bool _selfTestRunning = true;
+
+void timebase_init(void)
+{
+    TIM2->PSCR = TIM2_PRESCALER_16; // Prescale the 16MHz system clock to a 1us count
+
+    const uint16_t auto_reload = kTimebaseTickUs - 1;
+    TIM2->ARRH = (auto_reload >> 8);
+    TIM2->ARRL = (auto_reload & 0xFF);
+
+    TIM2->EGR = TIM2_EGR_UG; // Generate an update event to register new settings
+    TIM2->SR1 = 0; // Don't count the update event above as a tick
+
+    TIM2->IER = TIM2_IER_UIE; // Interrupt on overflow
+    TIM2->CR1 = TIM2_CR1_CEN; // Enable the counter
+}
+
+void timebase_enable_capture(void)
+{
+    // Capture on the rising edge of TI1 after it has been stable for 8 clock cycles
+    TIM2->CCMR1 = 0x30 | // Input filter: fMASTER, N=8
+                  0x01;  // CC1 channel is an input mapped to TI1
+    TIM2->CCER1 = TIM2_CCER1_CC1E; // Enable capture (CC1P clear selects the rising edge)
+
+    TIM2->IER |= TIM2_IER_CC1IE; // Interrupt on capture
+}
+
+/**
+ * Read the timestamp of the start of the current tick and the position within it
+ */
+static void timebase_read(uint32_t* tickStartOut, uint16_t* countOut)
+{
+    uint32_t tickStart;
+    uint16_t count;
+    bool overflowPending;
+
+    // The 32-bit tick start can't be read in one instruction, so the overflow interrupt must
+    // not run part way through. This saves and restores the previous interrupt state.
+    __critical {
+        tickStart = _tickStart;
+
+        // Most-significant byte must be read first to latch the least-significant byte
+        count = TIM2->CNTRH << 8;
+        count |= TIM2->CNTRL;
+
+        overflowPending = TIM2->SR1 & TIM2_SR1_UIF;
+    }
+
+    // Account for an overflow that hasn't been serviced yet (eg. when called from a higher
+    // priority interrupt). A large count means it was read before the overflow happened.
+    if (overflowPending && count < (kTimebaseTickUs / 2)) {
+        tickStart += kTimebaseTickUs;
+    }
+
+    *tickStartOut = tickStart;
+    *countOut = count;
+}
+
+uint32_t timebase_now(void)
+{
+    uint32_t tickStart;
+    uint16_t count;
+    timebase_read(&tickStart, &count);
+
+    return tickStart + count;
+}
+
+uint32_t timebase_capture_time(uint16_t capture, uint16_t* latency)
+{
+    uint32_t tickStart;
+    uint16_t count;
+    timebase_read(&tickStart, &count);
+
+    // A capture value ahead of the count must have been taken before the last overflow
+    if (count < capture) {
+        tickStart -= kTimebaseTickUs;
+        count += kTimebaseTickUs;
+    }
+
+    *latency = count - capture;
+
+    return tickStart + capture;
+}
+
+void timebase_end_self_test(void)
+{
+    _selfTestRunning = false;
+}
+
+void timebase_irq(void) __interrupt(ITC_IRQ_TIM2_OVF)
+{
+    static uint8_t subTicks = 0;
+
+    // Clear the overflow flag so this interrupt can fire again
+    TIM2->SR1 &= ~TIM2_SR1_UIF;
+
+    _tickStart += kTimebaseTickUs;
+
+    // Buttons are sampled every tick
+    sched_set_ready(kTask_Buttons);
+
+    // The start-up self-test steps on a multiple of ticks
+    if (_selfTestRunning) {
+        sched_set_ready(kTask_SelfTest);
+    }
+
+#if CONFIG_GPS_POWER_SAVE
+    // Holdover seconds are checked for every tick, so they're shown within a tick of being due
+    sched_set_ready(kTask_Holdover);
+#endif
+
+    // GPS supervision runs once per second
+    ++subTicks;
+    if (subTicks == kTimebaseTicksPerSecond) {
+        subTicks = 0;
+        sched_set_ready(kTask_GpsSupervisor);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+// This includes the typedefs normally found in stdint.h
+#include <stm8s.h>
+
+// Timer 2 counts microseconds and overflows once per tick
+#define kTimebaseTickUs 10000
+#define kTimebaseTicksPerSecond (1000000 / kTimebaseTickUs)
+
+/**
+ * Start TIM2 as a free-running 1MHz counter with an overflow interrupt every tick
+ */
+void timebase_init(void);
+
+/**
+ * Timestamp rising edges on TIM2 channel 1 (pin D4) with an interrupt on each capture
+ */
+void timebase_enable_capture(void);
+
+/**
+ * Return the number of microseconds since timebase_init() was called
+ *
+ * This wraps around at 2^32 (roughly every 71 minutes), so only differences between two
+ * readings are meaningful. It is safe to call from both the main loop and interrupt handlers.
+ */
+uint32_t timebase_now(void);
+
+/**
+ * Convert a TIM2 capture register value to a timebase timestamp
+ *
+ * This must be called within one tick of the capture. The time since the capture happened is
+ * written to latency in microseconds.
+ */
+uint32_t timebase_capture_time(uint16_t capture, uint16_t* latency);
+
+/**
+ * Stop readying kTask_SelfTest on each tick once the start-up self-test has finished
+ */
+void timebase_end_self_test(void);
+
+void timebase_irq(void) __interrupt(ITC_IRQ_TIM2_OVF);
@@ -0,0 +1,223 @@
+#include "timezone.h"
+
+#include "bcd.h"
+#include "calendar.h"
+
+// Offsets from UTC for standard time, in units of 15 minutes
+// This covers every offset in use, including half and three-quarter hour zones
+static const int8_t kTimezoneOffsets[kNumTimezones] = {
+    -48, -44, -40, -38, -36, -32, -28, -24, -20, -16, // UTC-12:00 to UTC-04:00
+    -14, -12,  -8,  -4,   0,   4,   8,  12,  14,  16, // UTC-03:30 to UTC+04:00
+     18,  20,  22,  23,  24,  26,  28,  32,  35,  36, // UTC+04:30 to UTC+09:00
+     38,  40,  42,  44,  48,  51,  52,  56,           // UTC+09:30 to UTC+14:00
+};
+
+// Marker for "last" in DstTransition.week
+#define kLastWeek 5
+
+/**
+ * Date and local time of a daylight saving transition, in the style of a POSIX TZ rule
+ * (Mm.w.d/hh:mm). The time is in the local time that's in effect before the transition.
+ */
+typedef struct DstTransition {
+    uint8_t month;   // 1 to 12
+    uint8_t week;    // 1 to 4 for the nth occurrence of the weekday, or kLastWeek
+    uint8_t weekday; // 0 = Sunday
+    uint8_t hour;
+    uint8_t minute;
+} DstTransition;
+
+typedef struct DstRule {
+    DstTransition start;
+    DstTransition end;
+
+    // Amount added to the standard offset during daylight time, in units of 15 minutes
+    int8_t save;
+} DstRule;
+
+static const DstRule kDstRules[kNumDstModes - kDstMode_Rule] = {
+    // New Zealand: M9.5.0,M4.1.0/3
+    { .start = {9, kLastWeek, 0, 2, 0}, .end = {4, 1, 0, 3, 0}, .save = 4 },
+
+    // South-east Australia: M10.1.0,M4.1.0/3
+    { .start = {10, 1, 0, 2, 0}, .end = {4, 1, 0, 3, 0}, .save = 4 },
+
+    // Central Europe: M3.5.0,M10.5.0/3
+    { .start = {3, kLastWeek, 0, 2, 0}, .end = {10, kLastWeek, 0, 3, 0}, .save = 4 },
+
+    // North America: M3.2.0,M11.1.0
+    { .start = {3, 2, 0, 2, 0}, .end = {11, 1, 0, 2, 0}, .save = 4 },
+
+    // Chatham Islands: M9.5.0/2:45,M4.1.0/3:45
+    { .start = {9, kLastWeek, 0, 2, 45}, .end = {4, 1, 0, 3, 45}, .save = 4 },
+};
+
+static uint8_t _zone = 0;
+static uint8_t _dstMode = kDstMode_Off;
+
+#if CONFIG_AUTO_TIMEZONE
+// Offset and daylight saving mode found from the GPS position
+static int8_t _autoOffset = 0;
+static uint8_t _autoDstMode = kDstMode_Off;
+#endif
+
+// Offset currently being applied (standard plus any daylight saving), in minutes
+static int16_t _offsetMinutes = 0;
+
+// UTC time of the next daylight saving transition
+// The year is set to 0xFF (which no real BCD year can reach) when there is no transition
+static DateTime _nextTransition;
+
+/**
+ * Return the standard offset of the selected zone in minutes
+ */
+static int16_t timezone_standard_minutes(void)
+{
+#if CONFIG_AUTO_TIMEZONE
+    if (_zone == kTimezoneAuto) {
+        return _autoOffset * 15;
+    }
+#endif
+
+    return kTimezoneOffsets[_zone] * 15;
+}
+
+/**
+ * Return the daylight saving mode in use
+ */
+static uint8_t timezone_active_dst_mode(void)
+{
+#if CONFIG_AUTO_TIMEZONE
+    if (_zone == kTimezoneAuto) {
+        return _autoDstMode;
+    }
+#endif
+
+    return _dstMode;
+}
+
+/**
+ * Calculate the UTC instant of a transition in the passed (BCD) year
+ *
+ * The offset is the one in effect before the transition, in minutes.
+ */
+static void timezone_transition_utc(DateTime* out, const DstTransition* rule, uint8_t year, int16_t offset)
+{
+    out->year = year;
+    out->month = bin_to_bcd(rule->month);
+    out->day = 0x01;
+    out->hour = bin_to_bcd(rule->hour);
+    out->minute = bin_to_bcd(rule->minute);
+    out->second = 0;
+
+    // Find the first occurrence of the weekday in the month
+    out->weekday = calendar_weekday(out);
+
+    uint8_t day = 1 + ((7 + rule->weekday - out->weekday) % 7);
+    out->weekday = rule->weekday;
+
+    // Move to the nth occurrence, stepping back a week if the month isn't long enough
+    day += (rule->week - 1) * 7;
+
+    if (day > bcd_to_bin(calendar_days_in_month(out))) {
+        day -= 7;
+    }
+
+    out->day = bin_to_bcd(day);
+
+    // Rule times are local, so move them to UTC
+    calendar_add_minutes(out, -offset);
+}
+
+void timezone_recalculate(const DateTime* utc)
+{
+    const int16_t standard = timezone_standard_minutes();
+    const uint8_t dstMode = timezone_active_dst_mode();
+
+    _nextTransition.year = 0xFF;
+
+    if (dstMode < kDstMode_Rule) {
+        _offsetMinutes = standard;
+
+        if (dstMode == kDstMode_On) {
+            _offsetMinutes += 60;
+        }
+
+        return;
+    }
+
+    const DstRule* rule = &kDstRules[dstMode - kDstMode_Rule];
+    const int16_t daylight = standard + (rule->save * 15);
+
+    // Find the earliest transition after now, looking into next year if both this year's
+    // transitions have passed. The state now is whatever that transition switches away from.
+    uint8_t year = utc->year;
+
+    for (uint8_t i = 0; i < 2; ++i) {
+        DateTime start;
+        DateTime end;
+
+        timezone_transition_utc(&start, &rule->start, year, standard);
+        timezone_transition_utc(&end, &rule->end, year, daylight);
+
+        const bool startAhead = calendar_compare(&start, utc) > 0;
+        const bool endAhead = calendar_compare(&end, utc) > 0;
+
+        if (startAhead && (!endAhead || calendar_compare(&start, &end) < 0)) {
+            _nextTransition = start;
+            _offsetMinutes = standard;
+            return;
+        }
+
+        if (endAhead) {
+            _nextTransition = end;
+            _offsetMinutes = daylight;
+            return;
+        }
+
+        year = (year == 0x99) ? 0x00 : bcd_increment(year);
+    }
+}
+
+void timezone_select(uint8_t zone, uint8_t dstMode, const DateTime* utc)
+{
+    _zone = zone;
+    _dstMode = dstMode;
+
+    timezone_recalculate(utc);
+}
+
+#if CONFIG_AUTO_TIMEZONE
+void timezone_set_auto(int8_t offset, uint8_t dstMode, const DateTime* utc)
+{
+    _autoOffset = offset;
+    _autoDstMode = dstMode;
+
+    timezone_recalculate(utc);
+}
+#endif
+
+bool timezone_check_transition(const DateTime* utc)
+{
+    if (calendar_compare(utc, &_nextTransition) < 0) {
+        return false;
+    }
+
+    timezone_recalculate(utc);
+    return true;
+}
+
+void timezone_to_local(DateTime* now)
+{
+    calendar_add_minutes(now, _offsetMinutes);
+}
+
+uint8_t timezone_get_zone(void)
+{
+    return _zone;
+}
+
+uint8_t timezone_get_dst_mode(void)
+{
+    return _dstMode;
+}
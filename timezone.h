@@ -0,0 +1,69 @@
+#pragma once
+
+#include "config.h"
+#include "nmea.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Daylight saving modes
+ *
+ * Modes from kDstMode_Rule onwards each select a rule from the built-in table.
+ */
+enum DstMode {
+    kDstMode_Off = 0, // Standard time all year
+    kDstMode_On,      // Daylight time all year (manual switching)
+    kDstMode_Rule,    // Switch automatically using the first rule in the table
+
+    // Total number of modes including one per rule
+    kNumDstModes = kDstMode_Rule + 5,
+};
+
+// Number of entries in the table of UTC offsets
+#define kNumTimezones 38
+
+#if CONFIG_AUTO_TIMEZONE
+// Zone selection that takes its offset and daylight saving rule from the GPS position
+#define kTimezoneAuto kNumTimezones
+#define kNumZoneChoices (kNumTimezones + 1)
+#else
+#define kNumZoneChoices kNumTimezones
+#endif
+
+/**
+ * Select a standard offset (index into the offset table) and daylight saving mode
+ *
+ * This recalculates the daylight saving state and next transition for the passed UTC time.
+ */
+void timezone_select(uint8_t zone, uint8_t dstMode, const DateTime* utc);
+
+/**
+ * Recalculate the daylight saving state after the UTC time has jumped
+ */
+void timezone_recalculate(const DateTime* utc);
+
+/**
+ * Check if a daylight saving transition has been reached (intended to be called every second)
+ *
+ * This costs one comparison unless a transition is reached. Returns true if the offset changed.
+ */
+bool timezone_check_transition(const DateTime* utc);
+
+/**
+ * Convert a UTC time to local time with the current offset
+ */
+void timezone_to_local(DateTime* now);
+
+#if CONFIG_AUTO_TIMEZONE
+/**
+ * Set the offset (in units of 15 minutes) and daylight saving mode used by kTimezoneAuto
+ */
+void timezone_set_auto(int8_t offset, uint8_t dstMode, const DateTime* utc);
+#endif
+
+/**
+ * Return the currently selected zone and daylight saving mode
+ */
+uint8_t timezone_get_zone(void);
+uint8_t timezone_get_dst_mode(void);
@@ -0,0 +1,95 @@
+#include "tzindex.h"
+
+#include "timezone.h"
+
+#if CONFIG_AUTO_TIMEZONE
+
+/**
+ * Area that overrides the grid, with bounds relative to the grid origin
+ */
+typedef struct TzException {
+    uint16_t latMin;
+    uint16_t latMax;
+    uint16_t lonMin;
+    uint16_t lonMax;
+    uint8_t zone;
+} TzException;
+
+#include "tzindex_data.h"
+
+// Distance a fix must move before the zone is looked up again (1/100ths of a degree)
+#define kTzMoveThreshold 10
+
+bool tzindex_lookup(int16_t latitude, uint16_t longitude, TzZone* output)
+{
+    if (latitude < kTzGridLatMin) {
+        return false;
+    }
+
+    // Work relative to the grid origin, wrapping longitude around the antimeridian
+    const uint16_t north = latitude - kTzGridLatMin;
+    uint16_t east = longitude - kTzGridLonMin;
+
+    if (longitude < kTzGridLonMin) {
+        east += 36000;
+    }
+
+    uint8_t zone = 0;
+
+    for (uint8_t i = 0; i < kTzNumExceptions; ++i) {
+        const TzException* exception = &kTzExceptions[i];
+
+        if (north >= exception->latMin && north < exception->latMax &&
+            east >= exception->lonMin && east < exception->lonMax) {
+            zone = exception->zone;
+            break;
+        }
+    }
+
+    if (zone == 0) {
+        const uint8_t row = north / kTzGridCellSize;
+        const uint8_t col = east / kTzGridCellSize;
+
+        if (row >= kTzGridRows || col >= kTzGridCols) {
+            return false;
+        }
+
+        // Two cells are packed in each byte
+        const uint16_t cell = (row * kTzGridCols) + col;
+        zone = kTzGrid[cell / 2];
+        zone = (cell & 1) ? (zone >> 4) : (zone & 0x0F);
+    }
+
+    if (zone == 0) {
+        return false;
+    }
+
+    *output = kTzZones[zone];
+    return true;
+}
+
+bool tzindex_update(const GpsPosition* position, TzZone* output)
+{
+    // Start at an impossible position so the first fix is always looked up
+    static int16_t lastLatitude = 0x7FFF;
+    static uint16_t lastLongitude = 0;
+
+    if (!position->valid) {
+        return false;
+    }
+
+    const int16_t latitudeMoved = position->latitude - lastLatitude;
+    const int16_t longitudeMoved = position->longitude - lastLongitude;
+
+    if (latitudeMoved < kTzMoveThreshold && latitudeMoved > -kTzMoveThreshold &&
+        longitudeMoved < kTzMoveThreshold && longitudeMoved > -kTzMoveThreshold) {
+        return false;
+    }
+
+    lastLatitude = position->latitude;
+    lastLongitude = position->longitude;
+
+    return tzindex_lookup(position->latitude, position->longitude, output);
+}
+
+#endif
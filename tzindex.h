@@ -0,0 +1,36 @@
+#pragma once
+
+#include "nmea.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if CONFIG_AUTO_TIMEZONE
+
+/**
+ * Timezone found for a position
+ */
+typedef struct TzZone {
+    // Standard offset from UTC in units of 15 minutes
+    int8_t offset;
+
+    // Daylight saving mode (DstMode)
+    uint8_t dstMode;
+} TzZone;
+
+/**
+ * Look up the timezone at a position in the generated index (tzindex_data.h)
+ *
+ * This takes bounded time: a check against each exception area and one grid cell read.
+ * Returns false if the position is outside the indexed region.
+ */
+bool tzindex_lookup(int16_t latitude, uint16_t longitude, TzZone* output);
+
+/**
+ * Look up the timezone for a new fix if it has moved far enough from the last lookup
+ *
+ * Returns true if a lookup was done and found a zone.
+ */
+bool tzindex_update(const GpsPosition* position, TzZone* output);
+
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+
+// Generated by scripts/tz_index.py from scripts/tz_region_anz.txt
+// Do not edit by hand: change the region file and regenerate this instead
+
+// Grid origin (south west corner) in 1/100ths of a degree, with longitude from 0 to 360 east
+#define kTzGridLatMin -5600
+#define kTzGridLonMin 11200
+#define kTzGridCellSize 400
+#define kTzGridRows 12
+#define kTzGridCols 18
+#define kTzNumExceptions 7
+
+// Standard offset and daylight saving mode of each zone ID (zone 0 is unknown)
+static const TzZone kTzZones[9] = {
+    {0, kDstMode_Off},
+    {32, kDstMode_Off},
+    {38, kDstMode_Off},
+    {38, kDstMode_Rule + 1},
+    {40, kDstMode_Off},
+    {40, kDstMode_Rule + 1},
+    {48, kDstMode_Rule + 0},
+    {51, kDstMode_Rule + 4},
+    {42, kDstMode_Off},
+};
+
+// Zone ID of each cell, two cells per byte (low nibble first), from the south west corner
+static const uint8_t kTzGrid[108] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x66, 0x66, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x60, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x60, 0x66, 0x66, 0x00, 0x00, 0x00, 0x50, 0x55, 0x00, 0x60, 0x66, 0x66,
+    0x00, 0x00, 0x33, 0x53, 0x55, 0x05, 0x60, 0x66, 0x66, 0x11, 0x11, 0x33,
+    0x53, 0x55, 0x05, 0x60, 0x66, 0x66, 0x11, 0x11, 0x33, 0x53, 0x55, 0x85,
+    0x60, 0x66, 0x66, 0x11, 0x11, 0x33, 0x43, 0x44, 0x04, 0x00, 0x00, 0x00,
+    0x11, 0x11, 0x22, 0x42, 0x44, 0x04, 0x00, 0x00, 0x00, 0x11, 0x11, 0x22,
+    0x42, 0x44, 0x04, 0x00, 0x00, 0x00, 0x11, 0x11, 0x22, 0x42, 0x44, 0x04,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x22, 0x44, 0x44, 0x04, 0x00, 0x00, 0x00,
+};
+
+// Areas that don't line up with the grid, checked in order before it
+// Bounds are in 1/100ths of a degree north and east of the grid origin
+static const TzException kTzExceptions[kTzNumExceptions] = {
+    {1140, 1250, 7100, 7200, 7},
+    {2380, 2430, 2920, 2970, 3},
+    {2700, 3000, 2900, 4200, 4},
+    {3000, 4700, 2600, 4200, 4},
+    {1700, 3000, 1700, 2900, 3},
+    {3000, 4600, 1700, 2600, 2},
+    {2000, 4300, 0, 1700, 1},
+};
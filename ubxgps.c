@@ -0,0 +1,840 @@
+#include "ubxgps.h"
+
+#include "bcd.h"
+#include "calendar.h"
+#include "gpsdriver.h"
+
+#include <stddef.h>
+
+#if CONFIG_UBX_INPUT
+
+
+enum UbxReadState {
+    kUbxReadSync2,
+    kUbxReadClass,
+    kUbxReadId,
+    kUbxReadLength1,
+    kUbxReadLength2,
+    kUbxReadPayload,
+    kUbxReadChecksumA,
+    kUbxReadChecksumB,
+};
+
+// Reader state, kept between calls as frames arrive a few bytes at a time
+static struct {
+    UbxFrame frame;
+
+    // Number of payload bytes read so far
+    uint16_t index;
+
+    // Running 8-bit Fletcher checksum over the class, ID, length and payload
+    uint8_t checksumA;
+    uint8_t checksumB;
+
+    enum UbxReadState state;
+} _ubx;
+
+// Days from the GPS epoch (6th January 1980) to 1st January 2000
+#define kGpsEpochTo2000Days 7300
+
+#define kMillisecondsPerDay 86400000UL
+
+void ubx_start_frame(void)
+{
+    _ubx.state = kUbxReadSync2;
+    _ubx.index = 0;
+    _ubx.checksumA = 0;
+    _ubx.checksumB = 0;
+}
+
+const UbxFrame* ubx_get_frame(void)
+{
+    return &_ubx.frame;
+}
+
+UbxReadStatus ubx_read_byte(uint8_t byte)
+{
+    // Everything between the sync characters and the checksum is included in the checksum
+    if (_ubx.state != kUbxReadSync2 && _ubx.state < kUbxReadChecksumA) {
+        _ubx.checksumA += byte;
+        _ubx.checksumB += _ubx.checksumA;
+    }
+
+    switch (_ubx.state) {
+        case kUbxReadSync2:
+            if (byte != kUbxSync2) {
+                return kUBX_Invalid;
+            }
+
+            _ubx.state = kUbxReadClass;
+            return kUBX_Incomplete;
+
+        case kUbxReadClass:
+            _ubx.frame.msgClass = byte;
+            _ubx.state = kUbxReadId;
+            return kUBX_Incomplete;
+
+        case kUbxReadId:
+            _ubx.frame.msgId = byte;
+            _ubx.state = kUbxReadLength1;
+            return kUBX_Incomplete;
+
+        case kUbxReadLength1:
+            _ubx.frame.length = byte;
+            _ubx.state = kUbxReadLength2;
+            return kUBX_Incomplete;
+
+        case kUbxReadLength2:
+            _ubx.frame.length |= ((uint16_t) byte << 8);
+            _ubx.state = (_ubx.frame.length == 0) ? kUbxReadChecksumA : kUbxReadPayload;
+            return kUBX_Incomplete;
+
+        case kUbxReadPayload:
+            // Bytes past the end of the stored payload are only checksummed
+            if (_ubx.index < kUbxMaxPayload) {
+                _ubx.frame.payload[_ubx.index] = byte;
+            }
+
+            ++_ubx.index;
+
+            if (_ubx.index == _ubx.frame.length) {
+                _ubx.state = kUbxReadChecksumA;
+            }
+
+            return kUBX_Incomplete;
+
+        case kUbxReadChecksumA:
+            if (byte != _ubx.checksumA) {
+                return kUBX_Invalid;
+            }
+
+            _ubx.state = kUbxReadChecksumB;
+            return kUBX_Incomplete;
+
+        case kUbxReadChecksumB:
+            return (byte == _ubx.checksumB) ? kUBX_Complete : kUBX_Invalid;
+
+        default:
+            return kUBX_Invalid;
+    }
+}
+
+/**
+ * Read a little-endian value from a payload
+ */
+static uint32_t ubx_read_u32(const uint8_t* data)
+{
+    return ((uint32_t) data[3] << 24) | ((uint32_t) data[2] << 16) | ((uint16_t) data[1] << 8) | data[0];
+}
+
+static uint16_t ubx_read_u16(const uint8_t* data)
+{
+    return ((uint16_t) data[1] << 8) | data[0];
+}
+
+bool ubx_decode_tim_tp(const UbxFrame* frame, DateTime* output, int32_t* quantisationError)
+{
+    // Payload layout
+    const uint8_t kTowMs = 0; // U4: time of week of the next pulse in milliseconds
+    const uint8_t kQuantisationError = 8; // I4: quantisation error of the next pulse in picoseconds
+    const uint8_t kWeek = 12; // U2: week number of the next pulse
+    const uint8_t kFlags = 14; // X1: time base flags
+    const uint8_t kPayloadLength = 16;
+
+    // Flags: bit 0 is set when the time base is UTC (rather than GPS), bit 1 when UTC is known
+    // The time pulse is configured on the UTC grid, so this only fails until the receiver knows UTC.
+    const uint8_t kFlagsUtc = 0x03;
+
+    if (frame->msgClass != kUbxClass_Tim || frame->msgId != kUbxId_TimTp || frame->length != kPayloadLength) {
+        return false;
+    }
+
+    if ((frame->payload[kFlags] & kFlagsUtc) != kFlagsUtc) {
+        return false;
+    }
+
+    const uint32_t towMs = ubx_read_u32(frame->payload + kTowMs);
+    const uint16_t week = ubx_read_u16(frame->payload + kWeek);
+
+    *quantisationError = (int32_t) ubx_read_u32(frame->payload + kQuantisationError);
+
+    // Date from the week and the day of the week (weeks start on Sunday)
+    calendar_set_days(output, (week * 7) + (towMs / kMillisecondsPerDay) - kGpsEpochTo2000Days);
+
+    // Time of day (the pulse is always at the top of a second)
+    uint32_t seconds = (towMs % kMillisecondsPerDay) / 1000;
+
+    output->second = bin_to_bcd(seconds % 60);
+    seconds /= 60;
+    output->minute = bin_to_bcd(seconds % 60);
+    output->hour = bin_to_bcd(seconds / 60);
+
+    return true;
+}
+
+bool ubx_decode_nav_timels(const UbxFrame* frame, UbxLeapSeconds* output)
+{
+    // Payload layout
+    const uint8_t kLeapSecondChange = 11; // I1: change at the next event (-1, 0 or +1)
+    const uint8_t kTimeToEvent = 12; // I4: seconds until the next event
+    const uint8_t kValid = 23; // X1: validity flags
+    const uint8_t kPayloadLength = 24;
+
+    // Validity flags
+    const uint8_t kValidTimeToEvent = 0x02;
+
+    if (frame->msgClass != kUbxClass_Nav || frame->msgId != kUbxId_NavTimeLs || frame->length != kPayloadLength) {
+        return false;
+    }
+
+    output->change = (frame->payload[kValid] & kValidTimeToEvent) ? (int8_t) frame->payload[kLeapSecondChange] : 0;
+    output->secondsToEvent = (int32_t) ubx_read_u32(frame->payload + kTimeToEvent);
+
+    return true;
+}
+
+#endif
+
+#if !CONFIG_GPS_MTK
+// Configuring the receiver (the u-blox implementation of gpsdriver.h)
+
+/**
+ * Add a value to a checksum (8-Bit Fletcher Algorithm)
+ * The initial checksum value must be {0,0}
+ */
+static inline void ubx_update_checksum(uint8_t* checksum, uint8_t value)
+{
+	checksum[0] += value;
+	checksum[1] += checksum[0];
+}
+
+static void ubx_update_checksum_multi(uint8_t* checksum, const uint8_t* data, uint16_t length)
+{
+	for (uint16_t i = 0; i < length; ++i) {
+		ubx_update_checksum(checksum, data[i]);
+	}
+}
+
+/**
+ * Send the sync characters and header of a frame, starting its checksum
+ */
+static void ubx_send_header(uint8_t* checksum, uint8_t msgClass, uint8_t msgId, uint16_t length)
+{
+    const uint8_t header[6] = {
+        0xB5, 0x62, // Every message starts with these sync characters
+        msgClass,
+        msgId,
+        (uint8_t) (length & 0xFF), // Payload length as little-endian (LSB first)
+        (uint8_t) (length >> 8),
+    };
+
+    checksum[0] = 0;
+    checksum[1] = 0;
+
+    // Checksum includes the payload and the header minus its two fixed bytes
+    ubx_update_checksum_multi(checksum, header + 2, sizeof(header) - 2);
+    uart_send(header, sizeof(header));
+}
+
+/**
+ * Send part of a frame's payload
+ */
+static void ubx_send_payload(uint8_t* checksum, const uint8_t* data, uint16_t length)
+{
+    ubx_update_checksum_multi(checksum, data, length);
+    uart_send(data, length);
+}
+
+// Receiver settings, shared by the CFG-VALSET and legacy configuration below
+
+// Account for 39.5us delay between top-of-second and complete display update
+#define kTimepulseOffsetNs 39500
+
+// Antenna cable delay (ns)
+#define kAntennaCableDelayNs 50
+
+// Length of the time pulse (us), and once locked to GPS time
+#define kTimepulseLengthUs 1000
+#define kTimepulseLockedLengthUs 10000
+
+// "Stationary" dynamic platform model, and either a 3D or 2D fix
+#define kDynamicModel 2
+#define kFixMode 3
+
+// Minimum satellite elevation (degrees)
+#define kMinElevation 20
+
+// Position and time DoP masks (10.0), and accuracy masks (m)
+#define kDopMask 100
+#define kAccuracyMask 100
+
+// Rates of the UBX messages read by the parser, in navigation solutions per message
+#if CONFIG_UBX_TIMEPULSE
+// Send the time of the next pulse every second
+#define kTimTpRate 1
+#endif
+#if CONFIG_LEAP_SECONDS
+// Send leap second information once a minute (announcements come months ahead)
+#define kNavTimeLsRate 60
+#endif
+
+// Configuration is sent one message at a time, each once the last has been acknowledged. The
+// acknowledgements arrive through the parser (ubx_handle_ack()), so nothing waits for them.
+// Each backend below has a fixed list of steps, ending with the NMEA rates that have changed.
+
+// Rates the receiver has acknowledged, or kRateUnknown before they're first set
+#define kRateUnknown 0xFF
+static uint8_t _sentRates[kNumGpsMessages];
+
+// Rates wanted (from gps_driver_init() or gps_driver_set_message_rates())
+static uint8_t _rates[kNumGpsMessages];
+
+// What _sentRates will be once the step waiting for acknowledgement is answered
+static uint8_t _pendingRates[kNumGpsMessages];
+
+// ID of the CFG message waiting for acknowledgement
+static uint8_t _pendingId;
+
+// Calls to ubx_config_retry() since the pending message was sent
+static uint8_t _pendingWaits;
+
+/**
+ * Send a CFG class message without waiting for it to be acknowledged
+ */
+static void ubx_queue(uint8_t msgId, const uint8_t* data, uint16_t length)
+{
+    uint8_t checksum[2];
+
+    ubx_send_header(checksum, 0x06, msgId, length);
+    ubx_send_payload(checksum, data, length);
+    uart_send(checksum, sizeof(checksum));
+
+    _pendingId = msgId;
+}
+
+/**
+ * Return true if a message's rate differs from the rate the receiver last acknowledged
+ */
+static inline bool ubx_rate_changed(uint8_t message)
+{
+    return _rates[message] != _sentRates[message];
+}
+
+/**
+ * Include a message's rate in the step being sent
+ */
+static inline void ubx_rate_pending(uint8_t message)
+{
+    _pendingRates[message] = _rates[message];
+}
+
+#if CONFIG_UBX_VALSET
+// Configuration keys used in CFG-VALSET (value size is in bits 28-30 of each key)
+#define kCfgTpPulseDef 0x20050023        // E1: time pulse defined by frequency (1)
+#define kCfgTpPulseLengthDef 0x20050030  // E1: pulse defined by length (1)
+#define kCfgTpAntCableDelay 0x30050001   // I2: antenna cable delay (ns)
+#define kCfgTpLenTp1 0x40050004          // U4: pulse length (us)
+#define kCfgTpLenLockTp1 0x40050005      // U4: pulse length when locked (us)
+#define kCfgTpUserDelayTp1 0x40050006    // I4: user delay (ns)
+#define kCfgTpTp1Ena 0x10050007          // L: enable the time pulse
+#define kCfgTpSyncGnssTp1 0x10050008     // L: sync to GNSS time when available
+#define kCfgTpUseLockedTp1 0x10050009    // L: use the locked settings when locked
+#define kCfgTpAlignToTowTp1 0x1005000A   // L: align to the top of the second
+#define kCfgTpPolTp1 0x1005000B          // L: rising edge at the top of the second
+#define kCfgTpTimegridTp1 0x2005000C     // E1: time grid (0 = UTC, 1 = GPS)
+#define kCfgTpFreqTp1 0x40050024         // U4: pulse frequency (Hz)
+#define kCfgTpFreqLockTp1 0x40050025     // U4: pulse frequency when locked (Hz)
+#define kCfgNavspgFixMode 0x20110011     // E1: fix mode
+#define kCfgNavspgDynModel 0x20110021    // E1: dynamic platform model
+#define kCfgNavspgInfilMinElev 0x201100A4 // I1: minimum elevation (degrees)
+#define kCfgNavspgOutfilPdop 0x301100B1  // U2: position DoP mask (0.1)
+#define kCfgNavspgOutfilTdop 0x301100B2  // U2: time DoP mask (0.1)
+#define kCfgNavspgOutfilPacc 0x301100B3  // U2: position accuracy mask (m)
+#define kCfgNavspgOutfilTacc 0x301100B4  // U2: time accuracy mask (m)
+#define kCfgInfmsgNmeaUart1 0x20920007   // X1: NMEA information messages (TXT)
+#define kCfgMsgoutNmeaDtmUart1 0x209100A7 // U1: DTM rate on UART1
+#define kCfgMsgoutNmeaGbsUart1 0x209100DE // U1: GBS rate on UART1
+#define kCfgMsgoutTimTpUart1 0x2091017E  // U1: TIM-TP rate on UART1
+#define kCfgMsgoutNavTimeLsUart1 0x20910061 // U1: NAV-TIMELS rate on UART1
+
+// Configuration layers a CFG-VALSET applies to
+#define kCfgLayerRam 0x01
+#define kCfgLayerBbr 0x02
+
+/**
+ * A configuration key and the value to set it to
+ */
+typedef struct UbxConfigItem {
+    uint32_t key;
+    uint32_t value;
+} UbxConfigItem;
+
+static const UbxConfigItem kUbxConfig[] = {
+    { kCfgTpPulseDef, 1 },
+    { kCfgTpPulseLengthDef, 1 },
+    { kCfgTpAntCableDelay, kAntennaCableDelayNs },
+    { kCfgTpFreqTp1, 1 },
+    { kCfgTpFreqLockTp1, 1 },
+    { kCfgTpLenTp1, kTimepulseLengthUs },
+    { kCfgTpLenLockTp1, kTimepulseLockedLengthUs },
+    { kCfgTpUserDelayTp1, kTimepulseOffsetNs },
+    { kCfgTpTp1Ena, 1 },
+    { kCfgTpSyncGnssTp1, 1 },
+    { kCfgTpUseLockedTp1, 1 },
+    { kCfgTpAlignToTowTp1, 1 },
+    { kCfgTpPolTp1, 1 },
+    { kCfgTpTimegridTp1, 0 }, // UTC, so TIM-TP reports UTC
+    { kCfgNavspgDynModel, kDynamicModel },
+    { kCfgNavspgFixMode, kFixMode },
+    { kCfgNavspgInfilMinElev, kMinElevation },
+    { kCfgNavspgOutfilPdop, kDopMask },
+    { kCfgNavspgOutfilTdop, kDopMask },
+    { kCfgNavspgOutfilPacc, kAccuracyMask },
+    { kCfgNavspgOutfilTacc, kAccuracyMask },
+    { kCfgInfmsgNmeaUart1, 0 },
+    { kCfgMsgoutNmeaDtmUart1, 0 },
+    { kCfgMsgoutNmeaGbsUart1, 0 },
+#if CONFIG_UBX_TIMEPULSE
+    { kCfgMsgoutTimTpUart1, kTimTpRate },
+#endif
+#if CONFIG_LEAP_SECONDS
+    { kCfgMsgoutNavTimeLsUart1, kNavTimeLsRate },
+#endif
+};
+
+// UART1 output rate key for each GpsMessage (all U1)
+static const uint16_t kUbxMessageRateKeys[kNumGpsMessages] = {
+    /* kGpsMessage_GGA: */ 0x00BB,
+    /* kGpsMessage_GLL: */ 0x00CA,
+    /* kGpsMessage_GSA: */ 0x00C0,
+    /* kGpsMessage_GSV: */ 0x00C5,
+    /* kGpsMessage_RMC: */ 0x00AC,
+    /* kGpsMessage_VTG: */ 0x00B1,
+    /* kGpsMessage_GRS: */ 0x00CF,
+    /* kGpsMessage_GST: */ 0x00D4,
+    /* kGpsMessage_ZDA: */ 0x00D9,
+};
+
+// High half shared by the message rate keys (CFG-MSGOUT group, one byte values)
+#define kCfgMsgoutKeyBase 0x20910000UL
+
+/**
+ * Return the number of bytes a configuration value takes, from the size field of its key
+ *
+ * Only sizes up to four bytes are supported, as values are stored in a uint32_t.
+ */
+static uint8_t ubx_config_value_size(uint32_t key)
+{
+    // 1: one bit (sent as a byte), 2: one byte, 3: two bytes, 4: four bytes
+    const uint8_t sizeField = (key >> 28) & 0x07;
+
+    return (sizeField <= 2) ? 1 : (1 << (sizeField - 2));
+}
+
+/**
+ * Send one key and value of a CFG-VALSET payload
+ */
+static void ubx_send_config_item(uint8_t* checksum, uint32_t key, uint32_t value)
+{
+    const uint8_t encoded[8] = { UBX_VALUE_U32(key), UBX_VALUE_U32(value) };
+
+    ubx_send_payload(checksum, encoded, 4 + ubx_config_value_size(key));
+}
+
+// Configuration steps
+enum UbxConfigStep {
+    kConfigStep_Settings = 0, // Everything in kUbxConfig, with any changed rates (RAM and BBR)
+    kConfigStep_Rates,        // Rates changed since (RAM only, as they change while running)
+
+    kNumConfigSteps
+};
+
+/**
+ * Send a CFG-VALSET with a list of configuration items and the message rates that changed
+ *
+ * The payload is encoded as it's sent, so it never needs to be held in RAM: only its length is
+ * worked out first. Returns false if there was nothing to set.
+ */
+static bool ubx_valset(uint8_t layers, const UbxConfigItem* items, uint8_t count)
+{
+    uint16_t length = 4;
+    uint8_t checksum[2];
+
+    for (uint8_t i = 0; i < count; ++i) {
+        length += 4 + ubx_config_value_size(items[i].key);
+    }
+
+    for (uint8_t message = 0; message < kNumGpsMessages; ++message) {
+        if (ubx_rate_changed(message)) {
+            length += 4 + 1;
+        }
+    }
+
+    if (length == 4) {
+        return false;
+    }
+
+    ubx_send_header(checksum, 0x06, 0x8A, length);
+
+    {
+        const uint8_t header[4] = {
+            UBX_VALUE_U8(0), // Message version
+            UBX_VALUE_U8(layers),
+            UBX_VALUE_U16(0), // Reserved
+        };
+
+        ubx_send_payload(checksum, header, sizeof(header));
+    }
+
+    for (uint8_t i = 0; i < count; ++i) {
+        ubx_send_config_item(checksum, items[i].key, items[i].value);
+    }
+
+    for (uint8_t message = 0; message < kNumGpsMessages; ++message) {
+        if (ubx_rate_changed(message)) {
+            ubx_send_config_item(checksum, kCfgMsgoutKeyBase | kUbxMessageRateKeys[message], _rates[message]);
+            ubx_rate_pending(message);
+        }
+    }
+
+    uart_send(checksum, sizeof(checksum));
+    _pendingId = 0x8A;
+
+    return true;
+}
+
+/**
+ * Send a configuration step, returning false if there was nothing to send for it
+ */
+static bool ubx_config_send(uint8_t step)
+{
+    if (step == kConfigStep_Settings) {
+        // Everything goes in a single transaction, kept in battery-backed RAM over power cycles
+        return ubx_valset(kCfgLayerRam | kCfgLayerBbr, kUbxConfig, sizeof(kUbxConfig) / sizeof(kUbxConfig[0]));
+    }
+
+    return ubx_valset(kCfgLayerRam, NULL, 0);
+}
+
+#else
+// Legacy configuration for receivers without CFG-VALSET (u-blox 8 and earlier)
+
+// CFG-TP5 flags
+#define kTp5Active 0x01         // Enable the time pulse
+#define kTp5LockGpsFreq 0x02    // Sync to GPS time when it's available
+#define kTp5LockedOtherSet 0x04 // Use the locked frequency and length once locked
+#define kTp5IsFreq 0x08         // Periods are given as frequencies
+#define kTp5IsLength 0x10       // Pulses are given as lengths rather than duty cycles
+#define kTp5AlignToTow 0x20     // Align the pulse to the top of a second
+#define kTp5Polarity 0x40       // Rising edge at the top of the second
+#define kTp5GridUtcGps 0x80     // Align to the GPS time grid (clear for UTC, so TIM-TP reports UTC)
+
+static const uint8_t gps_cfg_tp5_data[] = {
+    UBX_VALUE_U8(0), // Timepulse selection (only one available on NEO-6M)
+    UBX_VALUE_U8(0), // Reserved 0
+    UBX_VALUE_U16(0), // Reserved 1
+    UBX_VALUE_S16(kAntennaCableDelayNs), // Antenna cable delay (nS)
+    UBX_VALUE_S16(0), // RF group delay (readonly)
+    UBX_VALUE_U32(1), // Freqency of time pulse in Hz
+    UBX_VALUE_U32(1), // Freqency of time pulse in Hz when locked to GPS time
+    UBX_VALUE_U32(kTimepulseLengthUs), // Length of time pulse in uS
+    UBX_VALUE_U32(kTimepulseLockedLengthUs), // Length of time pulse in uS when locked to GPS time
+    UBX_VALUE_S32(kTimepulseOffsetNs), // User configurable timepuse delay (nS)
+    UBX_VALUE_U32((kTp5Active | kTp5LockGpsFreq | kTp5LockedOtherSet | kTp5IsFreq |
+                   kTp5IsLength | kTp5AlignToTow | kTp5Polarity)), // UTC grid
+};
+
+static const uint8_t gps_cfg_nav5_data[] = {
+    UBX_VALUE_U16(0b00111111), // Mask selecting settings to apply
+    UBX_VALUE_U8(kDynamicModel), // "Stationary" dynamic platform model
+    UBX_VALUE_U8(kFixMode), // Get either a 3D or 2D fix
+    UBX_VALUE_U32(0), // fixed altitude for 2D
+    UBX_VALUE_U32(0), // fixed altitude variance for 2D
+    UBX_VALUE_U8(kMinElevation), // minimum elevation is 20 degrees...
+    UBX_VALUE_U8(180), // maximum time to perform dead reckoning in case of GPS signal loss (s)
+    UBX_VALUE_U16(kDopMask), // position DoP mask is 10.0...
+    UBX_VALUE_U16(kDopMask), // time DoP mask is 10.0...
+    UBX_VALUE_U16(kAccuracyMask), // position accuracy mask in meters...
+    UBX_VALUE_U16(kAccuracyMask), // time accuracy mask in meters...
+    UBX_VALUE_U8(0), // static hold threshold is 0 cm/s...
+    UBX_VALUE_U8(60), // dynamic GNSS timeout is 60 seconds (not used)...
+    UBX_VALUE_U32(0), // Reserved
+    UBX_VALUE_U32(0), // Reserved
+    UBX_VALUE_U32(0), // Reserved
+};
+
+// Class and ID of messages to set the rate of (NMEA messages share the class byte 0xF0), and the rate
+// The standard NMEA sentences are set from GpsMessage.
+static const uint8_t gps_messageRates[][3] = {
+    { 0xF0, 0x0A, 0 }, // DTM (Datum Reference)
+    { 0xF0, 0x09, 0 }, // GBS (GNSS Satellite Fault Detection)
+    { 0xF0, 0x40, 0 }, // GPQ (Poll message)
+    { 0xF0, 0x0E, 0 }, // THS (True Heading and Status)
+    { 0xF0, 0x41, 0 }, // TXT (Text Transmission)
+#if CONFIG_UBX_TIMEPULSE
+    { kUbxClass_Tim, kUbxId_TimTp, kTimTpRate },
+#endif
+#if CONFIG_LEAP_SECONDS
+    { kUbxClass_Nav, kUbxId_NavTimeLs, kNavTimeLsRate },
+#endif
+};
+
+#define kNumMessageRates (sizeof(gps_messageRates) / sizeof(gps_messageRates[0]))
+
+// Configuration steps: two fixed messages, one per entry in gps_messageRates, then one per GpsMessage
+enum UbxConfigStep {
+    kConfigStep_Tp5 = 0,
+    kConfigStep_Nav5,
+    kConfigStep_Messages,
+    kConfigStep_Rates = kConfigStep_Messages + kNumMessageRates,
+
+    kNumConfigSteps = kConfigStep_Rates + kNumGpsMessages
+};
+
+/**
+ * Send a configuration step, returning false if there was nothing to send for it
+ */
+static bool ubx_config_send(uint8_t step)
+{
+    if (step == kConfigStep_Tp5) {
+        // Configure time-pulse
+        ubx_queue(0x31, gps_cfg_tp5_data, sizeof(gps_cfg_tp5_data));
+
+    } else if (step == kConfigStep_Nav5) {
+        // Configure stationary mode
+        ubx_queue(0x24, gps_cfg_nav5_data, sizeof(gps_cfg_nav5_data));
+
+    } else if (step < kConfigStep_Rates) {
+        ubx_queue(0x01, gps_messageRates[step - kConfigStep_Messages], sizeof(gps_messageRates[0]));
+
+    } else {
+        // GpsMessage values are the u-blox message IDs
+        const uint8_t message = step - kConfigStep_Rates;
+
+        if (!ubx_rate_changed(message)) {
+            return false;
+        }
+
+        const uint8_t cfg_msg_data[3] = {
+            0xF0, // Message class
+            message,
+            _rates[message], // Send rate
+        };
+
+        ubx_queue(0x01, cfg_msg_data, sizeof(cfg_msg_data));
+        ubx_rate_pending(message);
+    }
+
+    return true;
+}
+#endif
+
+#if CONFIG_GPS_POWER_SAVE
+// Power save is configured after everything else, once ubx_configure_power_save() asks for it
+// Acquisition runs at full power until then.
+enum UbxPowerSaveStep {
+    kConfigStep_PowerManagement = kNumConfigSteps,
+    kConfigStep_PowerSaveMode,
+
+    kConfigStep_Idle
+};
+
+enum UbxPowerSave {
+    kPowerSave_Off = 0,
+    kPowerSave_Requested,
+    kPowerSave_Configured,
+    kPowerSave_Rejected,
+};
+
+static enum UbxPowerSave _powerSave = kPowerSave_Off;
+
+static const uint8_t gps_cfg_pm2_data[] = {
+    UBX_VALUE_U8(1), // Message version
+    UBX_VALUE_U8(0), // Reserved
+    UBX_VALUE_U16(0), // Reserved
+    UBX_VALUE_U32((1 << 5) | (1 << 6) | (1 << 11) | (1 << 12)), // Flags: EXTINT0 controls wake (high) and backup (low), keep RTC and ephemeris updated
+    UBX_VALUE_U32(1000), // Update period (ms)
+    UBX_VALUE_U32(10000), // Search period after failing to acquire (ms)
+    UBX_VALUE_U32(0), // Grid offset (ms)
+    UBX_VALUE_U16(0), // On time after a fix (s)
+    UBX_VALUE_U16(0), // Minimum acquisition time (s)
+    UBX_VALUE_U32(0), // Reserved
+    UBX_VALUE_U32(0), // Reserved
+    UBX_VALUE_U32(0), // Reserved
+    UBX_VALUE_U32(0), // Reserved
+    UBX_VALUE_U32(0), // Reserved
+};
+
+static const uint8_t gps_cfg_rxm_data[] = {
+    UBX_VALUE_U8(8), // Reserved (must be 8)
+    UBX_VALUE_U8(1), // Power save mode
+};
+#else
+enum UbxPowerSaveStep {
+    kConfigStep_Idle = kNumConfigSteps
+};
+#endif
+
+// Next configuration step to send or be acknowledged, or kConfigStep_Idle when there's none
+static uint8_t _configStep = kConfigStep_Idle;
+
+/**
+ * Send a configuration step from the backend or the power save steps after it
+ * Returns false if there was nothing to send for the step.
+ */
+static bool ubx_config_send_step(uint8_t step)
+{
+#if CONFIG_GPS_POWER_SAVE
+    if (step >= kNumConfigSteps) {
+        if (_powerSave != kPowerSave_Requested) {
+            return false;
+        }
+
+        if (step == kConfigStep_PowerManagement) {
+            ubx_queue(0x3B, gps_cfg_pm2_data, sizeof(gps_cfg_pm2_data));
+        } else {
+            ubx_queue(0x11, gps_cfg_rxm_data, sizeof(gps_cfg_rxm_data));
+        }
+
+        return true;
+    }
+#endif
+
+    return ubx_config_send(step);
+}
+
+/**
+ * Return true if any rate differs from the rate the receiver last acknowledged
+ */
+static bool ubx_rates_changed(void)
+{
+    for (uint8_t message = 0; message < kNumGpsMessages; ++message) {
+        if (ubx_rate_changed(message)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Send the current configuration step, or the next one with anything to send
+ */
+static void ubx_config_continue(void)
+{
+    while (_configStep < kConfigStep_Idle) {
+        for (uint8_t message = 0; message < kNumGpsMessages; ++message) {
+            _pendingRates[message] = _sentRates[message];
+        }
+
+        if (ubx_config_send_step(_configStep)) {
+            _pendingWaits = 0;
+            return;
+        }
+
+        ++_configStep;
+
+        // Rates can change after their step was sent, so go over them again until they match
+        if (_configStep == kNumConfigSteps && ubx_rates_changed()) {
+            _configStep = kConfigStep_Rates;
+        }
+    }
+}
+
+/**
+ * Copy the rates wanted from the caller
+ */
+static void ubx_set_rates(const uint8_t* rates)
+{
+    for (uint8_t message = 0; message < kNumGpsMessages; ++message) {
+        _rates[message] = rates[message];
+    }
+}
+
+void gps_driver_init(const uint8_t* rates)
+{
+    // The receiver's own rates aren't known, so all of them are sent
+    for (uint8_t message = 0; message < kNumGpsMessages; ++message) {
+        _sentRates[message] = kRateUnknown;
+    }
+
+    ubx_set_rates(rates);
+
+    _configStep = 0;
+    ubx_config_continue();
+}
+
+void gps_driver_set_message_rates(const uint8_t* rates)
+{
+    ubx_set_rates(rates);
+
+    // Configuration in progress picks up the new rates when it gets to them
+    if (_configStep == kConfigStep_Idle) {
+        _configStep = kConfigStep_Rates;
+        ubx_config_continue();
+    }
+}
+
+void ubx_handle_ack(const UbxFrame* frame)
+{
+    // ACK-ACK and ACK-NAK both carry the class and ID of the message they answer
+    if (frame->msgClass != kUbxClass_Ack || frame->length != 2 ||
+        frame->payload[0] != 0x06 || frame->payload[1] != _pendingId ||
+        _configStep == kConfigStep_Idle) {
+        return;
+    }
+
+#if CONFIG_GPS_POWER_SAVE
+    // Sleeping relies on both power save messages, so a receiver without them never sleeps
+    if (_configStep >= kNumConfigSteps) {
+        if (frame->msgId != kUbxId_AckAck) {
+            _powerSave = kPowerSave_Rejected;
+        } else if (_configStep == kConfigStep_PowerSaveMode) {
+            _powerSave = kPowerSave_Configured;
+        }
+    }
+#endif
+
+    // A rejected message (eg. one an older receiver doesn't have) is skipped rather than retried
+    for (uint8_t message = 0; message < kNumGpsMessages; ++message) {
+        _sentRates[message] = _pendingRates[message];
+    }
+
+    _pendingId = 0;
+
+    ++_configStep;
+    ubx_config_continue();
+}
+
+void ubx_config_retry(void)
+{
+    if (_configStep == kConfigStep_Idle) {
+        return;
+    }
+
+    // Send the step again if it's gone two calls without an answer
+    ++_pendingWaits;
+
+    if (_pendingWaits == 2) {
+        ubx_config_continue();
+    }
+}
+
+#if CONFIG_GPS_POWER_SAVE
+bool ubx_configure_power_save(void)
+{
+    if (_powerSave == kPowerSave_Off) {
+        _powerSave = kPowerSave_Requested;
+
+        // Otherwise it's sent once the configuration in progress gets to it
+        if (_configStep == kConfigStep_Idle) {
+            _configStep = kConfigStep_PowerManagement;
+            ubx_config_continue();
+        }
+    }
+
+    return _powerSave == kPowerSave_Configured;
+}
+#endif
+
+#endif
@@ -1,5 +1,10 @@
 #pragma once
 
+#include "nmea.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
 // Macros to generate entries for UBX message payloads in a const uint8_t array
 // Values are split out into LSB-first order (little endian) per the UBX protocol docs
 // Signed variants exist only to help describe intention
@@ -14,4 +19,112 @@
 
 // 32-bit values
 #define UBX_VALUE_U32(x) (uint8_t)(((uint32_t)x) & 0xFF), (uint8_t)((((uint32_t)x) >> 8) & 0xFF), (uint8_t)((((uint32_t)x) >> 16) & 0xFF), (uint8_t)((((uint32_t)x) >> 24) & 0xFF)
-#define UBX_VALUE_S32(x) UBX_VALUE_U32(x)
\ No newline at end of file
+#define UBX_VALUE_S32(x) UBX_VALUE_U32(x)
+
+#if CONFIG_UBX_INPUT
+// Reading UBX frames from the receiver
+
+// Sync characters at the start of every frame
+#define kUbxSync1 0xB5
+#define kUbxSync2 0x62
+
+// Message classes and IDs read from the receiver
+#define kUbxClass_Ack 0x05
+#define kUbxId_AckAck 0x01
+#define kUbxClass_Tim 0x0D
+#define kUbxId_TimTp 0x01
+#define kUbxClass_Nav 0x01
+#define kUbxId_NavTimeLs 0x26
+
+// Largest payload kept from a frame. Longer frames are still checked, but can't be decoded.
+#define kUbxMaxPayload 24
+
+/**
+ * A frame received from the GPS
+ */
+typedef struct UbxFrame {
+    uint8_t msgClass;
+    uint8_t msgId;
+
+    // Payload length from the frame header (which may be longer than the stored payload)
+    uint16_t length;
+
+    uint8_t payload[kUbxMaxPayload];
+} UbxFrame;
+
+/**
+ * Leap second information from NAV-TIMELS
+ */
+typedef struct UbxLeapSeconds {
+    // Change at the next leap second (+1 or -1), or 0 if none is announced
+    int8_t change;
+
+    // Seconds until the next leap second (only valid if change is non-zero)
+    int32_t secondsToEvent;
+} UbxLeapSeconds;
+
+typedef enum UbxReadStatus {
+    // More bytes are needed to finish the frame
+    kUBX_Incomplete,
+
+    // A frame with a valid checksum was read into the frame returned by ubx_get_frame()
+    kUBX_Complete,
+
+    // The frame was malformed or failed its checksum
+    kUBX_Invalid,
+} UbxReadStatus;
+
+/**
+ * Start reading a new frame after its first sync character has been seen
+ */
+void ubx_start_frame(void);
+
+/**
+ * Feed the next byte of a frame started with ubx_start_frame()
+ */
+UbxReadStatus ubx_read_byte(uint8_t byte);
+
+/**
+ * Return the last frame read
+ */
+const UbxFrame* ubx_get_frame(void);
+
+/**
+ * Decode a TIM-TP (timepulse time data) frame into the UTC time of the next time pulse
+ *
+ * The quantisation error of the next pulse is written in picoseconds. Returns false if the frame
+ * isn't a TIM-TP message or the receiver doesn't know UTC yet.
+ */
+bool ubx_decode_tim_tp(const UbxFrame* frame, DateTime* output, int32_t* quantisationError);
+
+/**
+ * Decode a NAV-TIMELS (leap second event information) frame
+ * Returns false if the frame isn't a NAV-TIMELS message.
+ */
+bool ubx_decode_nav_timels(const UbxFrame* frame, UbxLeapSeconds* output);
+
+/**
+ * Pass a frame read from the receiver to the configuration started by gps_driver_init()
+ *
+ * An ACK-ACK or ACK-NAK for the message waiting to be answered sends the next one.
+ * Other frames are ignored.
+ */
+void ubx_handle_ack(const UbxFrame* frame);
+
+/**
+ * Call once a second to resend configuration the receiver hasn't answered
+ *
+ * Messages can be lost while the receiver is starting up, or at a baud rate it isn't using yet.
+ */
+void ubx_config_retry(void);
+
+#if CONFIG_GPS_POWER_SAVE
+/**
+ * Ask for EXTINT0-controlled power save to be configured, returning true once the receiver has accepted it
+ *
+ * The first call queues the configuration. Returns false until it's acknowledged, and for good if
+ * the receiver rejects it.
+ */
+bool ubx_configure_power_save(void);
+#endif
+#endif